@@ -0,0 +1,110 @@
+#include "distancefit.hpp"
+
+// MRA libraries
+#include "logging.hpp"
+
+using namespace MRA::FalconsLocalizationVision;
+
+
+DistanceFitFunction::DistanceFitFunction(cv::Mat const &distanceField, std::vector<cv::Point2f> const &rcsLinePoints, std::vector<float> const &weights, float ppm)
+{
+    int n = rcsLinePoints.size();
+    MRA_TRACE_FUNCTION_INPUTS(n);
+    _distanceField = distanceField;
+    _rcsLinePoints = rcsLinePoints;
+    _ppm = ppm;
+    double clip = 0.0;
+    cv::minMaxLoc(_distanceField, nullptr, &clip);
+    _clip = clip;
+    _sqrtWeights.reserve(weights.size());
+    for (auto w: weights)
+    {
+        _sqrtWeights.push_back(sqrt(std::max(0.0f, w)));
+    }
+}
+
+cv::Mat DistanceFitFunction::createDistanceField(cv::Mat const &referenceFloor, float ppm, double clip)
+{
+    MRA_TRACE_FUNCTION_INPUTS(ppm, clip);
+    // lines (white, potentially blurred) become zero, everything else gets the distance to the nearest line
+    cv::Mat nonLines;
+    cv::threshold(referenceFloor, nonLines, 127, 255, cv::THRESH_BINARY_INV);
+    cv::Mat result;
+    cv::distanceTransform(nonLines, result, cv::DIST_L2, cv::DIST_MASK_5);
+    // truncate, so far away outliers do not dominate the least-squares problem
+    cv::min(result, clip * ppm, result);
+    return result;
+}
+
+float DistanceFitFunction::interpolate(float u, float v, float &dDdu, float &dDdv) const
+{
+    // pixel (col,row) covers [col,col+1) x [row,row+1), consistent with FitFunction::calc, so its center is at +0.5
+    float uu = u - 0.5f;
+    float vv = v - 0.5f;
+    int c = (int)floor(uu);
+    int r = (int)floor(vv);
+    dDdu = 0.0f;
+    dDdv = 0.0f;
+    if (c < 0 || r < 0 || c + 1 >= _distanceField.cols || r + 1 >= _distanceField.rows)
+    {
+        return _clip;
+    }
+    float a = uu - c;
+    float b = vv - r;
+    float d00 = _distanceField.at<float>(r, c);
+    float d10 = _distanceField.at<float>(r, c + 1);
+    float d01 = _distanceField.at<float>(r + 1, c);
+    float d11 = _distanceField.at<float>(r + 1, c + 1);
+    dDdu = (1.0f - b) * (d10 - d00) + b * (d11 - d01);
+    dDdv = (1.0f - a) * (d01 - d00) + a * (d11 - d10);
+    return (1.0f - a) * (1.0f - b) * d00 + a * (1.0f - b) * d10 + (1.0f - a) * b * d01 + a * b * d11;
+}
+
+double DistanceFitFunction::calc(const double *v, cv::Mat *residuals, cv::Mat *jacobian) const
+{
+    double x = v[0];
+    double y = v[1];
+    double rz = v[2];
+    MRA_TRACE_FUNCTION_INPUTS(x, y, rz);
+    _evaluations++;
+    int n = _rcsLinePoints.size();
+    if (residuals)
+    {
+        residuals->create(n, 1, CV_64FC1);
+    }
+    if (jacobian)
+    {
+        jacobian->create(n, 3, CV_64FC1);
+    }
+    // same transformations as FitFunction: RCS to FCS, then FCS to PCS (flip xy, scale, origin at center)
+    double c = cos(rz);
+    double s = sin(rz);
+    double result = 0.0;
+    for (int i = 0; i < n; ++i)
+    {
+        double px = _rcsLinePoints[i].x;
+        double py = _rcsLinePoints[i].y;
+        double dx = c * px - s * py; // fcs.x - x
+        double dy = s * px + c * py; // fcs.y - y
+        float u = _ppm * (y + dy) + 0.5 * _distanceField.cols;
+        float w = _ppm * (x + dx) + 0.5 * _distanceField.rows;
+        float dDdu = 0.0f, dDdw = 0.0f;
+        float d = interpolate(u, w, dDdu, dDdw);
+        double sw = (_sqrtWeights.size() ? _sqrtWeights[i] : 1.0);
+        double ri = sw * d / _ppm; // [m]
+        result += ri * ri;
+        if (residuals)
+        {
+            residuals->at<double>(i, 0) = ri;
+        }
+        if (jacobian)
+        {
+            // chain rule: du/dy = ppm, dw/dx = ppm, du/drz = ppm*dx, dw/drz = -ppm*dy
+            jacobian->at<double>(i, 0) = sw * dDdw;
+            jacobian->at<double>(i, 1) = sw * dDdu;
+            jacobian->at<double>(i, 2) = sw * (dDdu * dx - dDdw * dy);
+        }
+    }
+    MRA_TRACE_FUNCTION_OUTPUT(result);
+    return result;
+}
@@ -0,0 +1,42 @@
+#ifndef _MRA_FALCONS_LOCALIZATION_VISION_DISTANCEFIT_HPP
+#define _MRA_FALCONS_LOCALIZATION_VISION_DISTANCEFIT_HPP
+
+#include <opencv2/opencv.hpp>
+#include "FalconsLocalizationVision_datatypes.hpp"
+
+
+namespace MRA::FalconsLocalizationVision
+{
+
+// least-squares counterpart of FitFunction, for gradient-based optimizers
+// residual per linepoint is its distance (in meters) to the nearest line, looked up in a distance field
+// bilinear interpolation of the field provides analytic derivatives with respect to (x,y,rz)
+class DistanceFitFunction
+{
+public:
+    DistanceFitFunction(cv::Mat const &distanceField, std::vector<cv::Point2f> const &rcsLinePoints, std::vector<float> const &weights, float ppm);
+
+    // weighted sum of squared residuals at pose v=(x,y,rz)
+    // optionally also fill the residual vector (n x 1) and jacobian (n x 3)
+    double calc(const double *v, cv::Mat *residuals = nullptr, cv::Mat *jacobian = nullptr) const;
+    int getEvaluations() const { return _evaluations; }
+
+    // distance (in pixels) of each pixel to the nearest white pixel of the reference floor, truncated at clip (in meters)
+    static cv::Mat createDistanceField(cv::Mat const &referenceFloor, float ppm, double clip);
+
+private:
+    cv::Mat _distanceField; // CV_32FC1
+    std::vector<cv::Point2f> _rcsLinePoints;
+    std::vector<float> _sqrtWeights; // empty means all 1.0
+    float _ppm;
+    float _clip; // [pixels] value used outside of the field
+    mutable int _evaluations = 0;
+
+    // bilinear interpolation at (column, row) pixel coordinates, including partial derivatives
+    float interpolate(float u, float v, float &dDdu, float &dDdv) const;
+
+}; // class DistanceFitFunction
+
+} // namespace MRA::FalconsLocalizationVision
+
+#endif
@@ -1,4 +1,5 @@
 #include "fit.hpp"
+#include <numeric>
 
 // MRA libraries
 #include "opencv_utils.hpp"
@@ -9,26 +10,51 @@ using namespace MRA::FalconsLocalizationVision;
 const double RAD2DEG = 180.0 / M_PI;
 
 
-void FitAlgorithm::run(cv::Mat const &referenceFloor, std::vector<cv::Point2f> const &rcsLinePoints, std::vector<Tracker> &trackers)
+void FitAlgorithm::run(cv::Mat const &referenceFloor, std::vector<cv::Point2f> const &rcsLinePoints, std::vector<float> const &linePointWeights, std::vector<Tracker> &trackers)
 {
-    MRA_TRACE_FUNCTION();
-    // TODO: multithreading
+    int numTrackers = trackers.size();
+    MRA_TRACE_FUNCTION_INPUTS(numTrackers);
 
-    // run all fit attempts
-    for (auto &tr: trackers)
+    // run all fit attempts, trackers are independent so they can be distributed over threads
+    // each thread writes only into its own trackers
+    int numStripes = std::min(numTrackers, 1 + std::max(0, settings.numextrathreads()));
+    auto fitTrackers = [&](const cv::Range &range)
+    {
+        for (int it = range.start; it < range.end; ++it)
+        {
+            Tracker &tr = trackers[it];
+            FitResult fr = _fitCore.run(referenceFloor, rcsLinePoints, linePointWeights, tr.guess, tr.step);
+            tr.fitResult = fr.pose;
+            tr.fitValid = fr.valid;
+            tr.fitScore = fr.score;
+            tr.fitPath = std::move(fr.path);
+            tr.fitEvaluations = fr.evaluations;
+        }
+    };
+    if (numStripes > 1)
     {
-        FitResult fr = _fitCore.run(referenceFloor, rcsLinePoints, tr.guess, tr.step);
-        tr.fitResult = fr.pose;
-        tr.fitValid = fr.valid;
-        tr.fitScore = fr.score;
-        tr.fitPath = fr.path;
+        cv::parallel_for_(cv::Range(0, numTrackers), fitTrackers, numStripes);
+    }
+    else
+    {
+        fitTrackers(cv::Range(0, numTrackers));
     }
 
     // sort trackers on decreasing quality
-    std::sort(trackers.begin(), trackers.end());
+    // stable, so on equal quality the first tracker (based on input guess) remains the best one
+    std::stable_sort(trackers.begin(), trackers.end());
 }
 
-FitResult FitCore::run(cv::Mat const &referenceFloor, std::vector<cv::Point2f> const &rcsLinePoints, MRA::Geometry::Pose const &guess, MRA::Geometry::Pose const &step)
+FitResult FitCore::run(cv::Mat const &referenceFloor, std::vector<cv::Point2f> const &rcsLinePoints, std::vector<float> const &linePointWeights, MRA::Geometry::Pose const &guess, MRA::Geometry::Pose const &step)
+{
+    if (settings.optimizer() == OptimizerEnum::LEVENBERG_MARQUARDT)
+    {
+        return runLevenbergMarquardt(referenceFloor, rcsLinePoints, linePointWeights, guess, step);
+    }
+    return runDownhillSimplex(referenceFloor, rcsLinePoints, linePointWeights, guess, step);
+}
+
+FitResult FitCore::runDownhillSimplex(cv::Mat const &referenceFloor, std::vector<cv::Point2f> const &rcsLinePoints, std::vector<float> const &linePointWeights, MRA::Geometry::Pose const &guess, MRA::Geometry::Pose const &step)
 {
     int numpoints = rcsLinePoints.size();
     MRA::Datatypes::Pose guess_ = guess;
@@ -40,7 +66,10 @@ FitResult FitCore::run(cv::Mat const &referenceFloor, std::vector<cv::Point2f> c
     auto cvSolver = cv::DownhillSolver::create();
 
     // configure solver
-    cv::Ptr<FitFunction> f = new FitFunction(referenceFloor, rcsLinePoints, settings.pixelspermeter());
+    cv::Ptr<FitFunction> f = new FitFunction(referenceFloor, rcsLinePoints, settings.pixelspermeter(), settings.pathpoints().enabled());
+    f->setWeights(linePointWeights);
+    f->setShapeField(shapeField);
+    f->setFixedPoint(settings.fixedpoint());
     cvSolver->setFunction(f);
     cv::Mat stepVec = (cv::Mat_<double>(3, 1) << step.x, step.y, step.rz);
     cvSolver->setInitStep(stepVec);
@@ -60,21 +89,155 @@ FitResult FitCore::run(cv::Mat const &referenceFloor, std::vector<cv::Point2f> c
     result.pose.x = (vec.at<double>(0, 0));
     result.pose.y = (vec.at<double>(0, 1));
     result.pose.rz = (vec.at<double>(0, 2));
-    result.path = f->getPath();
+    result.path = std::move(f->getPath());
+    result.evaluations = f->getEvaluations();
     return result;
 }
 
-FitFunction::FitFunction(cv::Mat const &referenceFloor, std::vector<cv::Point2f> const &rcsLinePoints, float ppm)
+FitResult FitCore::runLevenbergMarquardt(cv::Mat const &referenceFloor, std::vector<cv::Point2f> const &rcsLinePoints, std::vector<float> const &linePointWeights, MRA::Geometry::Pose const &guess, MRA::Geometry::Pose const &step)
 {
-    MRA_TRACE_FUNCTION();
+    int numpoints = rcsLinePoints.size();
+    MRA::Datatypes::Pose guess_ = guess;
+    MRA::Datatypes::Pose step_ = step;
+    MRA_TRACE_FUNCTION_INPUTS(numpoints, guess_, step_);
+    FitResult result;
+    bool recordPath = settings.pathpoints().enabled();
+    if (distanceField.size() != referenceFloor.size())
+    {
+        throw std::runtime_error("FitCore: Levenberg-Marquardt requires the distance field of the reference floor");
+    }
+
+    // iterate: solve (JtJ + lambda*diag(JtJ)) delta = -Jt r
+    // the step acts as trust region: delta is clipped to it, so a single update cannot jump out of the basin
+    // on improvement, accept and reduce damping (towards Gauss-Newton), otherwise increase damping (towards gradient descent)
+    DistanceFitFunction f(distanceField, rcsLinePoints, linePointWeights, settings.pixelspermeter());
+    double v[3] = {guess.x, guess.y, guess.rz};
+    double maxDelta[3] = {fabs(step.x), fabs(step.y), fabs(step.rz)};
+    double lambda = settings.levenbergmarquardt().lambda();
+    cv::Mat r, J;
+    double cost = f.calc(v, &r, &J);
+    for (int iteration = 0; iteration < settings.maxcount(); ++iteration)
+    {
+        cv::Mat JtJ = J.t() * J;
+        cv::Mat Jtr = J.t() * r;
+        cv::Mat A = JtJ.clone();
+        for (int k = 0; k < 3; ++k)
+        {
+            A.at<double>(k, k) += lambda * JtJ.at<double>(k, k) + 1e-12; // keep it solvable when a direction is unobservable
+        }
+        cv::Mat delta;
+        if (!cv::solve(A, -Jtr, delta, cv::DECOMP_CHOLESKY))
+        {
+            break;
+        }
+        double vNew[3];
+        double deltaSize = 0.0;
+        for (int k = 0; k < 3; ++k)
+        {
+            double d = std::max(-maxDelta[k], std::min(maxDelta[k], delta.at<double>(k, 0)));
+            vNew[k] = v[k] + d;
+            deltaSize = std::max(deltaSize, fabs(d));
+        }
+        cv::Mat rNew, JNew;
+        double costNew = f.calc(vNew, &rNew, &JNew);
+        if (costNew < cost)
+        {
+            std::copy(vNew, vNew + 3, v);
+            cost = costNew;
+            r = rNew;
+            J = JNew;
+            lambda *= 0.1;
+            if (recordPath)
+            {
+                result.path.push_back(MRA::Geometry::Pose(v[0], v[1], v[2]));
+            }
+            if (deltaSize < settings.epsilon())
+            {
+                break;
+            }
+        }
+        else
+        {
+            // plain Gauss-Newton (no damping) has nothing to fall back on,
+            // and when even the rejected step is below epsilon, more damping only shrinks it further: converged
+            if (lambda <= 0.0 || lambda > 1e8 || deltaSize < settings.epsilon())
+            {
+                break;
+            }
+            lambda *= 10.0;
+        }
+    }
+    result.evaluations = f.getEvaluations();
+
+    // score with the regular FitFunction, so confidence is comparable between optimizers
+    FitFunction score(referenceFloor, rcsLinePoints, settings.pixelspermeter());
+    score.setWeights(linePointWeights);
+    score.setShapeField(shapeField);
+    score.setFixedPoint(settings.fixedpoint());
+    result.score = score.calc(v);
+    result.evaluations += score.getEvaluations();
+    result.valid = true; // TODO score threshold
+    result.pose.x = v[0];
+    result.pose.y = v[1];
+    result.pose.rz = v[2];
+    int evaluations = result.evaluations;
+    MRA_TRACE_FUNCTION_OUTPUTS(cost, evaluations);
+    return result;
+}
+
+FitFunction::FitFunction(cv::Mat const &referenceFloor, std::vector<cv::Point2f> const &rcsLinePoints, float ppm, bool recordPath)
+{
+    MRA_TRACE_FUNCTION_INPUTS(recordPath);
     _ppm = ppm;
+    _recordPath = recordPath;
     _referenceFloor = referenceFloor;
     _rcsLinePoints = rcsLinePoints;
     // count pixels for normalization, prevent division by zero when no linepoints present (yet)
     _rcsLinePointsPixelCount = rcsLinePoints.size();
+    _fcs2pcs = transformationMatrixFCS2PCS();
+    MRA_TRACE_FUNCTION_OUTPUT(_rcsLinePointsPixelCount);
+}
+
+void FitFunction::setWeights(std::vector<float> const &weights)
+{
+    int n = weights.size();
+    MRA_TRACE_FUNCTION_INPUTS(n);
+    if (weights.size() && weights.size() != _rcsLinePoints.size())
+    {
+        throw std::runtime_error("FitFunction: number of weights (" + std::to_string(weights.size()) + ") does not match number of linepoints (" + std::to_string(_rcsLinePoints.size()) + ")");
+    }
+    _weights = weights;
+    _boundedOrder.clear();
+    // normalize on total weight, so score remains in [0.0, 1.0]
+    _rcsLinePointsPixelCount = _rcsLinePoints.size();
+    if (_weights.size())
+    {
+        _rcsLinePointsPixelCount = std::max(1e-6, (double)std::accumulate(_weights.begin(), _weights.end(), 0.0));
+    }
     MRA_TRACE_FUNCTION_OUTPUT(_rcsLinePointsPixelCount);
 }
 
+void FitFunction::setShapeField(std::shared_ptr<ShapeField const> shapeField)
+{
+    MRA_TRACE_FUNCTION();
+    _shapeField = shapeField;
+}
+
+void FitFunction::setFixedPoint(bool enabled)
+{
+    MRA_TRACE_FUNCTION_INPUTS(enabled);
+    _q16LinePoints.clear();
+    if (enabled)
+    {
+        // int32 Q16 pixel coordinates suffice for floors up to 32k pixels
+        _q16LinePoints.reserve(_rcsLinePoints.size());
+        for (auto const &p: _rcsLinePoints)
+        {
+            _q16LinePoints.emplace_back((int)lround(p.x * _ppm * 65536.0), (int)lround(p.y * _ppm * 65536.0));
+        }
+    }
+}
+
 double FitFunction::calcOverlap(cv::Mat const &m1, cv::Mat const &m2) const
 {
     MRA_TRACE_FUNCTION();
@@ -119,7 +282,7 @@ std::vector<cv::Point2f> FitFunction::transformPoints(const std::vector<cv::Poin
     // FCS: field coordinate system
     // PCS: pixel coordinate system, applies to (reference) floor cv::Mat
 
-    cv::Mat transformationMatrix33 = transformationMatrixFCS2PCS() * tmat;
+    cv::Mat transformationMatrix33 = _fcs2pcs * tmat;
     cv::Mat transformationMatrix32 = transformationMatrix33(cv::Rect(0, 0, 3, 2));
 
     // Transform
@@ -141,6 +304,98 @@ double FitFunction::calc(const double *v) const
     double y = v[1];
     double rz = v[2];
     MRA_TRACE_FUNCTION_INPUTS(x, y, rz);
+    _evaluations++;
+    double score = _shapeField ? calcAnalytic(x, y, rz) : (_q16LinePoints.size() ? calcFixedPoint(x, y, rz) : calcRaster(x, y, rz));
+    if (_recordPath)
+    {
+        _fitpath.push_back(MRA::Geometry::Pose(x, y, rz));
+    }
+    // final normalization to 0..1 where 0 is good (minimization)
+    double result = 1.0 - score / _rcsLinePointsPixelCount;
+    MRA_TRACE_FUNCTION_OUTPUT(result);
+    return result;
+}
+
+void FitFunction::prepareBounded() const
+{
+    MRA_TRACE_FUNCTION();
+    int n = _rcsLinePoints.size();
+    _boundedOrder.resize(n);
+    std::iota(_boundedOrder.begin(), _boundedOrder.end(), 0);
+    auto distance2 = [this](int i) { return _rcsLinePoints[i].x * _rcsLinePoints[i].x + _rcsLinePoints[i].y * _rcsLinePoints[i].y; };
+    std::stable_sort(_boundedOrder.begin(), _boundedOrder.end(), [&](int a, int b) { return distance2(a) > distance2(b); });
+    _boundedRemaining.assign(n + 1, 0.0);
+    for (int k = n - 1; k >= 0; --k)
+    {
+        int i = _boundedOrder[k];
+        _boundedRemaining[k] = _boundedRemaining[k + 1] + (_weights.size() ? _weights[i] : 1.0);
+    }
+}
+
+double FitFunction::calcBounded(const double *v, double threshold) const
+{
+    double x = v[0];
+    double y = v[1];
+    double rz = v[2];
+    MRA_TRACE_FUNCTION_INPUTS(x, y, rz, threshold);
+    _evaluations++;
+    if (_boundedOrder.size() != _rcsLinePoints.size())
+    {
+        prepareBounded();
+    }
+    // same transformation as calcRaster (float, like cv::transform), calcFixedPoint or calcAnalytic
+    cv::Mat m64 = _fcs2pcs * transformationMatrixRCS2FCS(x, y, rz);
+    cv::Mat_<float> m;
+    m64.convertTo(m, CV_32F);
+    FixedPointTransform t = _q16LinePoints.size() ? fixedPointTransform(x, y, rz) : FixedPointTransform();
+    double c = cos(rz);
+    double s = sin(rz);
+    double score = 0.0;
+    double result = 0.0;
+    int n = _boundedOrder.size();
+    for (int k = 0; k < n; ++k)
+    {
+        // stop when even a perfect score on all remaining linepoints cannot get below threshold
+        double bound = 1.0 - (score + _boundedRemaining[k]) / _rcsLinePointsPixelCount;
+        if (bound > threshold)
+        {
+            MRA_TRACE_FUNCTION_OUTPUT(bound);
+            return bound;
+        }
+        int i = _boundedOrder[k];
+        float px = _rcsLinePoints[i].x;
+        float py = _rcsLinePoints[i].y;
+        double si = 0.0;
+        if (_shapeField)
+        {
+            si = _shapeField->score(x + c * px - s * py, y + s * px + c * py);
+        }
+        else if (_q16LinePoints.size())
+        {
+            si = fixedPointLookup(t, i);
+        }
+        else
+        {
+            int pixelX = static_cast<int>(m(0, 0) * px + m(0, 1) * py + m(0, 2));
+            int pixelY = static_cast<int>(m(1, 0) * px + m(1, 1) * py + m(1, 2));
+            if (pixelX >= 0 && pixelX < _referenceFloor.cols && pixelY >= 0 && pixelY < _referenceFloor.rows)
+            {
+                si = static_cast<float>(_referenceFloor.at<uchar>(pixelY, pixelX)) / 255.0;
+            }
+        }
+        score += (_weights.size() ? _weights[i] * si : si);
+    }
+    if (_recordPath)
+    {
+        _fitpath.push_back(MRA::Geometry::Pose(x, y, rz));
+    }
+    result = 1.0 - score / _rcsLinePointsPixelCount;
+    MRA_TRACE_FUNCTION_OUTPUT(result);
+    return result;
+}
+
+double FitFunction::calcRaster(double x, double y, double rz) const
+{
     double score = 0.0;
     std::vector<cv::Point2f> transformed = transformPoints(_rcsLinePoints, transformationMatrixRCS2FCS(x, y, rz));
     for (size_t i = 0; i < _rcsLinePoints.size(); ++i)
@@ -153,17 +408,70 @@ double FitFunction::calc(const double *v) const
         {
             // Look up pixel intensity in _referenceFloor and accumulate the score
             s = static_cast<float>(_referenceFloor.at<uchar>(pixelY, pixelX)) / 255.0;
-            score += s; // max 1.0 per pixel
+            score += (_weights.size() ? _weights[i] * s : s); // max 1.0 per pixel
         }
         MRA_LOG_DEBUG("calc %3d   rx=%8.3f  ry=%8.3f  px=%4d py=%4d  s=%6.2f", (int)i, _rcsLinePoints[i].x, _rcsLinePoints[i].y, (int)(pixelX), (int)(pixelY), s);
     }
-    _fitpath.push_back(MRA::Geometry::Pose(x, y, rz));
-    // final normalization to 0..1 where 0 is good (minimization)
-    double result = 1.0 - score / _rcsLinePointsPixelCount;
-    MRA_TRACE_FUNCTION_OUTPUT(result);
+    return score;
+}
+
+FitFunction::FixedPointTransform FitFunction::fixedPointTransform(double x, double y, double rz) const
+{
+    // RCS2FCS followed by FCS2PCS (which flips xy and scales), worked out for ppm-scaled linepoints (qx,qy):
+    //     pixelX = s * qx + c * qy + ppm * y + 0.5 * cols
+    //     pixelY = c * qx - s * qy + ppm * x + 0.5 * rows
+    FixedPointTransform result;
+    result.c = llround(cos(rz) * 65536.0);
+    result.s = llround(sin(rz) * 65536.0);
+    result.tx = llround((_ppm * y + _fcs2pcs.at<double>(0, 2)) * 65536.0);
+    result.ty = llround((_ppm * x + _fcs2pcs.at<double>(1, 2)) * 65536.0);
     return result;
 }
 
+float FitFunction::fixedPointLookup(FixedPointTransform const &t, int i) const
+{
+    cv::Point2i const &q = _q16LinePoints[i];
+    // Q16 * Q16 needs 64 bits, shift back to Q16, then to integer pixels (floor)
+    int pixelX = (int)((((t.s * q.x + t.c * q.y) >> 16) + t.tx) >> 16);
+    int pixelY = (int)((((t.c * q.x - t.s * q.y) >> 16) + t.ty) >> 16);
+    // unsigned comparison also rejects negative indices
+    if ((unsigned)pixelX < (unsigned)_referenceFloor.cols && (unsigned)pixelY < (unsigned)_referenceFloor.rows)
+    {
+        return _referenceFloor.ptr<uchar>(pixelY)[pixelX] * (1.0f / 255.0f);
+    }
+    return 0.0f;
+}
+
+double FitFunction::calcFixedPoint(double x, double y, double rz) const
+{
+    // only the pose-dependent rotation and translation are applied per evaluation, in integer arithmetic
+    FixedPointTransform t = fixedPointTransform(x, y, rz);
+    double score = 0.0;
+    int n = _q16LinePoints.size();
+    for (int i = 0; i < n; ++i)
+    {
+        float s = fixedPointLookup(t, i);
+        score += (_weights.size() ? _weights[i] * s : s); // max 1.0 per pixel
+    }
+    return score;
+}
+
+double FitFunction::calcAnalytic(double x, double y, double rz) const
+{
+    // transform RCS to FCS directly, no pixels involved
+    double score = 0.0;
+    double c = cos(rz);
+    double s = sin(rz);
+    for (size_t i = 0; i < _rcsLinePoints.size(); ++i)
+    {
+        double px = _rcsLinePoints[i].x;
+        double py = _rcsLinePoints[i].y;
+        double si = _shapeField->score(x + c * px - s * py, y + s * px + c * py); // max 1.0 per linepoint
+        score += (_weights.size() ? _weights[i] * si : si);
+    }
+    return score;
+}
+
 cv::Mat FitFunction::transformationMatrixRCS2FCS(double x, double y, double rz) const
 {
     MRA_TRACE_FUNCTION_INPUTS(x, y, rz);
@@ -5,6 +5,8 @@
 #include "geometry.hpp"
 #include "FalconsLocalizationVision_datatypes.hpp"
 #include "tracker.hpp"
+#include "distancefit.hpp"
+#include "shapefield.hpp"
 
 
 namespace MRA::FalconsLocalizationVision
@@ -16,7 +18,8 @@ struct FitResult
     bool valid = false;
     float score = 0.0;
     MRA::Geometry::Pose pose;
-    std::vector<MRA::Geometry::Pose> path;
+    std::vector<MRA::Geometry::Pose> path; // diagnostics, only filled when pathPoints are enabled
+    int evaluations = 0; // number of scoring function evaluations, for benchmarking the optimizers
     bool operator<(FitResult const &other) { return score < other.score; }
 }; // struct FitResult
 
@@ -24,8 +27,15 @@ struct FitResult
 class FitFunction: public cv::MinProblemSolver::Function
 {
 public:
-    FitFunction(cv::Mat const &referenceFloor, std::vector<cv::Point2f> const &rcsLinePoints, float ppm);
+    FitFunction(cv::Mat const &referenceFloor, std::vector<cv::Point2f> const &rcsLinePoints, float ppm, bool recordPath = false);
     double calc(const double *x) const; // this is the main scoring function to be minimized, x is a tuple (x,y,rz)
+    // bounded variant of calc, for rejecting candidates early (branch-and-bound)
+    // returns the same value as calc when that is at most threshold, otherwise some lower bound which exceeds threshold
+    // linepoints far from the robot are processed first, as they are most likely to miss, which tightens the bound quickly
+    double calcBounded(const double *x, double threshold) const;
+    void setWeights(std::vector<float> const &weights); // optional per-linepoint weights, empty means all 1.0
+    void setShapeField(std::shared_ptr<ShapeField const> shapeField); // optional: score analytically instead of on the reference floor
+    void setFixedPoint(bool enabled); // optional: raster scoring in Q16 fixed-point, see SolverParams.fixedPoint
     int getDims() const { return 3; }
 
     // helpers, public for testing purposes and diagnostics
@@ -33,15 +43,36 @@ public:
     cv::Mat transform3dof(cv::Mat const &m, double x, double y, double rz) const; // TODO remove??
     std::vector<cv::Point2f> transformPoints(const std::vector<cv::Point2f> &points, cv::Mat tmat = cv::Mat::eye(3, 3, CV_64FC1)) const;
     cv::Mat transformationMatrixRCS2FCS(double x, double y, double rz) const;
-    std::vector<MRA::Geometry::Pose> &getPath();
+    std::vector<MRA::Geometry::Pose> &getPath(); // only filled when recordPath is set
+    int getEvaluations() const { return _evaluations; }
 
 private:
     cv::Mat _referenceFloor;
     std::vector<cv::Point2f> _rcsLinePoints;
+    std::vector<float> _weights;
+    std::shared_ptr<ShapeField const> _shapeField;
+    double calcAnalytic(double x, double y, double rz) const; // sum of linepoint scores
+    double calcRaster(double x, double y, double rz) const; // sum of linepoint scores
+    double calcFixedPoint(double x, double y, double rz) const; // sum of linepoint scores, same as calcRaster but in Q16
+    // for calcBounded: linepoint order, and the maximum score still obtainable from position i onwards
+    mutable std::vector<int> _boundedOrder;
+    mutable std::vector<double> _boundedRemaining;
+    void prepareBounded() const;
     double _rcsLinePointsPixelCount = 1.0; // for score normalization
     float _ppm; // needed to optimize in FCS instead of pixels
     cv::Mat transformationMatrixFCS2PCS() const;
+    cv::Mat _fcs2pcs; // calculated once, only depends on floor size and ppm
+    // fixed-point path: linepoints scaled by ppm in Q16, calculated once, so only the pose-dependent part remains per evaluation
+    std::vector<cv::Point2i> _q16LinePoints;
+    struct FixedPointTransform
+    {
+        int64_t c, s, tx, ty; // Q16 rotation and translation in pixels, see fixedPointTransform
+    };
+    FixedPointTransform fixedPointTransform(double x, double y, double rz) const;
+    float fixedPointLookup(FixedPointTransform const &t, int i) const; // pixel intensity of linepoint i in [0.0, 1.0], 0.0 when outside
+    bool _recordPath = false;
     mutable std::vector<MRA::Geometry::Pose> _fitpath;
+    mutable int _evaluations = 0;
 }; // class FitFunction
 
 
@@ -54,12 +85,24 @@ public:
     SolverParams settings;
     void configure(SolverParams const &config) { settings.CopyFrom(config); }
 
+    // analytic scoring (see ScoringEnum), shared between threads, read-only
+    std::shared_ptr<ShapeField const> shapeField;
+
+    // distance field of the reference floor, required for Levenberg-Marquardt, shared between threads, read-only
+    // see DistanceFitFunction::createDistanceField, cached in state by the Solver
+    cv::Mat distanceField;
+
     FitResult run(
         cv::Mat const &referenceFloor,      // params translated once (at first tick) to reference floor to fit against, white pixels, potentially blurred
         std::vector<cv::Point2f> const &rcsLinePoints,
+        std::vector<float> const &linePointWeights, // optional, see FitFunction::setWeights
         MRA::Geometry::Pose const &guess,   // initial guess for the algorithm, note that the simplex is constructed AROUND it, so somewhere a shift might be needed
         MRA::Geometry::Pose const &step);   // initial step: search region
 
+private:
+    FitResult runDownhillSimplex(cv::Mat const &referenceFloor, std::vector<cv::Point2f> const &rcsLinePoints, std::vector<float> const &linePointWeights, MRA::Geometry::Pose const &guess, MRA::Geometry::Pose const &step);
+    FitResult runLevenbergMarquardt(cv::Mat const &referenceFloor, std::vector<cv::Point2f> const &rcsLinePoints, std::vector<float> const &linePointWeights, MRA::Geometry::Pose const &guess, MRA::Geometry::Pose const &step);
+
 }; // class FitCore
 
 
@@ -71,10 +114,13 @@ public:
 
     SolverParams settings;
     void configure(SolverParams const &config) { settings.CopyFrom(config); _fitCore.configure(config); }
+    void setShapeField(std::shared_ptr<ShapeField const> shapeField) { _fitCore.shapeField = shapeField; }
+    void setDistanceField(cv::Mat const &distanceField) { _fitCore.distanceField = distanceField; }
 
     void run(
         cv::Mat const &referenceFloor,      // params translated once (at first tick) to reference floor to fit against, white pixels, potentially blurred
         std::vector<cv::Point2f> const &rcsLinePoints,
+        std::vector<float> const &linePointWeights, // optional, see FitFunction::setWeights
         std::vector<Tracker> &trackers);    // list of trackers/attempts to run, multithreaded if so configured
 
 private:
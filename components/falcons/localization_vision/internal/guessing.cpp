@@ -1,39 +1,75 @@
 #include "guessing.hpp"
+#include "logging.hpp"
 
 using namespace MRA::FalconsLocalizationVision;
 
 
-Guesser::Guesser(Params const &params)
+Guesser::Guesser(Params const &params, int tick)
 {
+    _params = params;
     _config = params.solver().guessing();
     _floorMaxX = 0.5 * params.model().b();
     _floorMaxY = 0.5 * params.model().a();
+    _symmetry = params.solver().symmetry();
+    _rng.seed(_config.random().seed() + tick);
 }
 
-std::optional<MRA::Datatypes::Point> Guesser::createRandomGuess(std::vector<MRA::Geometry::Point> const &pointsToAvoid) const
+MRA::Geometry::Point Guesser::canonical(MRA::Geometry::Point const &p) const
 {
-    std::optional<MRA::Datatypes::Point> result;
-    for (int iAttempt = 0; iAttempt < _config.random().maxtries(); ++iAttempt)
+    if (!_symmetry)
+    {
+        return p;
+    }
+    MRA::Geometry::Pose result = canonicalPose(MRA::Geometry::Pose(p.x, p.y));
+    return MRA::Geometry::Point(result.x, result.y);
+}
+
+bool Guesser::isTooClose(MRA::Geometry::Point const &candidate, std::vector<MRA::Geometry::Point> const &pointsToAvoid) const
+{
+    for (auto const &pt: pointsToAvoid)
     {
-        MRA::Geometry::Point candidate(
-            (2.0 * rand() / RAND_MAX - 1.0) * _floorMaxX,
-            (2.0 * rand() / RAND_MAX - 1.0) * _floorMaxY);
-        bool tooClose = false;
-        for (auto const &pt: pointsToAvoid)
+        if ((candidate - pt).size() < _config.random().exclusionradius())
         {
-            tooClose |= ((candidate - pt).size() < _config.random().exclusionradius());
+            return true;
         }
-        if (!tooClose)
+    }
+    return false;
+}
+
+std::optional<MRA::Datatypes::Point> Guesser::createRandomGuess(std::vector<MRA::Geometry::Point> const &pointsToAvoid)
+{
+    std::optional<MRA::Datatypes::Point> result;
+    std::uniform_real_distribution<double> distX(-_floorMaxX, _floorMaxX);
+    std::uniform_real_distribution<double> distY(_symmetry ? 0.0 : -_floorMaxY, _floorMaxY);
+    for (int iAttempt = 0; iAttempt < _config.random().maxtries(); ++iAttempt)
+    {
+        MRA::Geometry::Point candidate(distX(_rng), distY(_rng));
+        if (!isTooClose(candidate, pointsToAvoid))
         {
             result = (MRA::Datatypes::Point)candidate;
+            break;
         }
     }
     return result;
 }
 
-void Guesser::run(std::vector<Tracker> &trackers, bool initial) const
+Tracker Guesser::createTracker(MRA::Datatypes::Circle const &circle) const
 {
-/*
+    // a guess only specifies a search region in (x,y), orientation is unknown
+    // so the simplex is constructed around the circle center, spanning the full rotation
+    TrackerState st;
+    st.mutable_pose()->set_x(circle.center().x());
+    st.mutable_pose()->set_y(circle.center().y());
+    Tracker result(_params, st);
+    result.step = MRA::Geometry::Pose(circle.radius(), circle.radius(), 0.0, 0.0, 0.0, 2.0 * M_PI);
+    result.guess.rz -= 0.5 * result.step.rz;
+    return result;
+}
+
+void Guesser::run(std::vector<Tracker> &trackers, bool initial)
+{
+    int numExisting = trackers.size();
+    MRA_TRACE_FUNCTION_INPUTS(numExisting, initial);
 
     // if so configured, add new fit attempts (as trackers)
     // so that the fit algorithm can run them all
@@ -41,23 +77,30 @@ void Guesser::run(std::vector<Tracker> &trackers, bool initial) const
     std::vector<MRA::Geometry::Point> pointsToAvoid;
     for (auto const &tr: trackers)
     {
-        pointsToAvoid.push_back(tr.xy());
+        pointsToAvoid.push_back(canonical(MRA::Geometry::Point(tr.guess.x, tr.guess.y)));
     }
 
-    // note: pointsToAvoid is a vector copy that might be growing
-    auto gvec = _config.structural();
-    std::vector<MRA::Datatypes::Circle> result(gvec.begin(), gvec.end());
-    // initial guesses only at the very first tick
+    // structural guesses each tick, initial guesses only at the very first tick
+    std::vector<MRA::Datatypes::Circle> guesses(_config.structural().begin(), _config.structural().end());
     if (initial)
     {
-        gvec = _config.initial();
-        std::copy(gvec.begin(), gvec.end(), std::back_inserter(result));
+        std::copy(_config.initial().begin(), _config.initial().end(), std::back_inserter(guesses));
     }
-    // register result so far as avoidance
-    for (auto const &circle: result)
+
+    // deduplicate: skip guesses too close to existing trackers or to already accepted guesses
+    std::vector<MRA::Datatypes::Circle> accepted;
+    // with symmetry, a guess in the other half is equivalent to its mirror, which may then be a duplicate
+    for (auto circle: guesses)
     {
-        pointsToAvoid.push_back(MRA::Geometry::Point(circle.center()));
+        MRA::Geometry::Point center = canonical(MRA::Geometry::Point(circle.center()));
+        if (!isTooClose(center, pointsToAvoid))
+        {
+            circle.mutable_center()->CopyFrom((MRA::Datatypes::Point)center);
+            accepted.push_back(circle);
+            pointsToAvoid.push_back(center);
+        }
     }
+
     // add random guesses?
     auto rgParams = _config.random();
     bool doRandom = rgParams.count() && rgParams.searchradius() && rgParams.maxtries();
@@ -67,15 +110,20 @@ void Guesser::run(std::vector<Tracker> &trackers, bool initial) const
         std::optional<MRA::Datatypes::Point> pt = createRandomGuess(pointsToAvoid);
         if (pt)
         {
-            // store
             MRA::Datatypes::Circle gc;
-            gc.mutable_center()->set_x(pt->x());
-            gc.mutable_center()->set_y(pt->y());
+            gc.mutable_center()->CopyFrom(*pt);
             gc.set_radius(rgParams.searchradius());
-            result.push_back(gc);
+            accepted.push_back(gc);
             pointsToAvoid.push_back(*pt);
         }
     }
-*/
-}
 
+    // convert to trackers
+    for (auto const &circle: accepted)
+    {
+        trackers.push_back(createTracker(circle));
+    }
+
+    int numAdded = trackers.size() - numExisting;
+    MRA_TRACE_FUNCTION_OUTPUT(numAdded);
+}
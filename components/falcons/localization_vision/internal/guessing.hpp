@@ -2,6 +2,7 @@
 #define _MRA_FALCONS_LOCALIZATION_VISION_GUESSING_HPP
 
 #include <optional>
+#include <random>
 
 #include "FalconsLocalizationVision_datatypes.hpp"
 #include "tracker.hpp"
@@ -12,21 +13,29 @@ namespace MRA::FalconsLocalizationVision
 class Guesser
 {
 public:
-    Guesser(Params const &params);
+    Guesser(Params const &params, int tick = 0);
     ~Guesser() {};
 
-    void run(std::vector<Tracker> &trackers, bool initial = true) const;
+    // add a deduplicated batch of trackers: structural guesses, initial guesses (only if initial is set) and random guesses
+    void run(std::vector<Tracker> &trackers, bool initial = true);
 
 private:
+    Params _params;
     GuessingParams _config;
     float _floorMaxX;
     float _floorMaxY;
+    bool _symmetry = false; // only guess in the canonical half of the field
 
-    std::optional<MRA::Datatypes::Point> createRandomGuess(std::vector<MRA::Geometry::Point> const &pointsToAvoid) const;
+    // owned by this guesser (so not shared between threads), seeded for reproducibility
+    std::mt19937 _rng;
+
+    std::optional<MRA::Datatypes::Point> createRandomGuess(std::vector<MRA::Geometry::Point> const &pointsToAvoid);
+    MRA::Geometry::Point canonical(MRA::Geometry::Point const &p) const;
+    bool isTooClose(MRA::Geometry::Point const &candidate, std::vector<MRA::Geometry::Point> const &pointsToAvoid) const;
+    Tracker createTracker(MRA::Datatypes::Circle const &circle) const;
 
 }; // class Guesser
 
 } // namespace MRA::FalconsLocalizationVision
 
 #endif
-
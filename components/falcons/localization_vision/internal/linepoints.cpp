@@ -0,0 +1,95 @@
+#include "linepoints.hpp"
+
+// MRA libraries
+#include "logging.hpp"
+
+using namespace MRA::FalconsLocalizationVision;
+
+
+LinePointPreprocessor::LinePointPreprocessor(Params const &params)
+{
+    _fitConfig = params.solver().linepoints().fit();
+    _config = params.solver().linepoints().preprocess();
+}
+
+void LinePointPreprocessor::run(std::vector<cv::Point2f> &points, std::vector<float> &weights) const
+{
+    int numInput = points.size();
+    MRA_TRACE_FUNCTION_INPUTS(numInput);
+    weights.clear();
+    if (_config.gridsize() > 0.0)
+    {
+        decimate(points);
+    }
+    if (_config.maxcount() > 0 && (int)points.size() > _config.maxcount())
+    {
+        limit(points);
+    }
+    if (_config.distanceweighting())
+    {
+        weights.reserve(points.size());
+        for (auto const &p: points)
+        {
+            weights.push_back(weight(p));
+        }
+    }
+    int numOutput = points.size();
+    MRA_TRACE_FUNCTION_OUTPUT(numOutput);
+}
+
+float LinePointPreprocessor::weight(cv::Point2f const &point) const
+{
+    // far away linepoints are less reliable (camera calibration, pixel size)
+    // the configured linepoint radius shrinks with distance, use the relative radius as weight
+    double distance = sqrt(point.x * point.x + point.y * point.y);
+    double radius = std::max(_fitConfig.radiusminimum(), _fitConfig.radiusconstant() + _fitConfig.radiusscalefactor() * distance);
+    return std::max(0.0, std::min(1.0, radius / _fitConfig.radiusconstant()));
+}
+
+void LinePointPreprocessor::decimate(std::vector<cv::Point2f> &points) const
+{
+    MRA_TRACE_FUNCTION();
+    // voxel grid: accumulate per cell, then replace all points in the cell by their centroid
+    // cells are ordered by first occurrence, so the result does not depend on hashing
+    struct Cell
+    {
+        double sumX = 0.0;
+        double sumY = 0.0;
+        int count = 0;
+    };
+    double gridSize = _config.gridsize();
+    std::unordered_map<uint64_t, int> cellIndex;
+    std::vector<Cell> cells;
+    cellIndex.reserve(points.size());
+    for (auto const &p: points)
+    {
+        int32_t ix = (int32_t)floor(p.x / gridSize);
+        int32_t iy = (int32_t)floor(p.y / gridSize);
+        // cell indices are negative for negative coordinates, so pack them as unsigned
+        uint64_t key = ((uint64_t)(uint32_t)ix << 32) | (uint32_t)iy;
+        auto it = cellIndex.find(key);
+        if (it == cellIndex.end())
+        {
+            it = cellIndex.emplace(key, (int)cells.size()).first;
+            cells.push_back(Cell());
+        }
+        Cell &cell = cells[it->second];
+        cell.sumX += p.x;
+        cell.sumY += p.y;
+        cell.count++;
+    }
+    points.resize(cells.size());
+    for (size_t ic = 0; ic < cells.size(); ++ic)
+    {
+        points[ic] = cv::Point2f(cells[ic].sumX / cells[ic].count, cells[ic].sumY / cells[ic].count);
+    }
+}
+
+void LinePointPreprocessor::limit(std::vector<cv::Point2f> &points) const
+{
+    MRA_TRACE_FUNCTION();
+    // far away linepoints are least reliable, so these are dropped first
+    auto closer = [](cv::Point2f const &a, cv::Point2f const &b) { return (a.x * a.x + a.y * a.y) < (b.x * b.x + b.y * b.y); };
+    std::nth_element(points.begin(), points.begin() + _config.maxcount(), points.end(), closer);
+    points.resize(_config.maxcount());
+}
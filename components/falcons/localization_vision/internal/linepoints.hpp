@@ -0,0 +1,38 @@
+#ifndef _MRA_FALCONS_LOCALIZATION_VISION_LINEPOINTS_HPP
+#define _MRA_FALCONS_LOCALIZATION_VISION_LINEPOINTS_HPP
+
+#include <opencv2/opencv.hpp>
+#include "FalconsLocalizationVision_datatypes.hpp"
+
+
+namespace MRA::FalconsLocalizationVision
+{
+
+// preprocessing of input linepoints (RCS), before fitting
+// this bounds the cost per evaluation of FitFunction::calc, when vision sends a lot of linepoints
+class LinePointPreprocessor
+{
+public:
+    LinePointPreprocessor(Params const &params);
+    ~LinePointPreprocessor() {};
+
+    // modifies points in-place, weights are only filled when distance weighting is enabled
+    void run(std::vector<cv::Point2f> &points, std::vector<float> &weights) const;
+
+    // weight of a linepoint in [0.0, 1.0], based on its distance to the robot
+    float weight(cv::Point2f const &point) const;
+
+private:
+    LinePointFitParams _fitConfig;
+    LinePointPreprocessParams _config;
+
+    // keep one (averaged) linepoint per grid cell
+    void decimate(std::vector<cv::Point2f> &points) const;
+    // keep the linepoints closest to the robot
+    void limit(std::vector<cv::Point2f> &points) const;
+
+}; // class LinePointPreprocessor
+
+} // namespace MRA::FalconsLocalizationVision
+
+#endif
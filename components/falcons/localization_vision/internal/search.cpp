@@ -0,0 +1,175 @@
+#include "search.hpp"
+#include "fit.hpp"
+#include <queue>
+
+// MRA libraries
+#include "logging.hpp"
+
+using namespace MRA::FalconsLocalizationVision;
+
+
+GlobalSearch::GlobalSearch(Params const &params)
+{
+    _config = params.solver().globalsearch();
+    _ppm = params.solver().pixelspermeter();
+    _floorMaxX = 0.5 * params.model().b();
+    _floorMaxY = 0.5 * params.model().a();
+    _symmetry = params.solver().symmetry();
+    _fixedPoint = params.solver().fixedpoint();
+}
+
+MRA::Geometry::Pose GlobalSearch::finalStep() const
+{
+    // each refinement level halves the step
+    double f = 1.0 / (1 << std::max(0, _config.pyramidlevels()));
+    return MRA::Geometry::Pose(f * _config.gridstepxy(), f * _config.gridstepxy(), 0.0, 0.0, 0.0, f * _config.gridsteprz());
+}
+
+std::vector<cv::Mat> GlobalSearch::createPyramid(cv::Mat const &referenceFloor) const
+{
+    MRA_TRACE_FUNCTION();
+    // level 0 is the full resolution reference floor, every next level halves the resolution
+    std::vector<cv::Mat> result;
+    result.push_back(referenceFloor);
+    for (int level = 1; level <= _config.pyramidlevels(); ++level)
+    {
+        cv::Mat m;
+        cv::pyrDown(result.back(), m);
+        result.push_back(m);
+    }
+    return result;
+}
+
+std::vector<SearchPeak> GlobalSearch::selectPeaks(std::vector<SearchPeak> &candidates, double stepXY, double stepRz) const
+{
+    MRA_TRACE_FUNCTION();
+    // best first, then greedily pick the peaks, suppressing neighbors of already selected peaks
+    // (otherwise the top-K would typically be a single cluster around the best pose)
+    std::vector<SearchPeak> result;
+    std::sort(candidates.begin(), candidates.end());
+    for (auto const &c: candidates)
+    {
+        if ((int)result.size() >= _config.numpeaks())
+        {
+            break;
+        }
+        bool suppressed = false;
+        for (auto const &peak: result)
+        {
+            bool closeXY = (MRA::Geometry::Point(c.pose) - MRA::Geometry::Point(peak.pose)).size() < 2.0 * stepXY;
+            bool closeRz = fabs(MRA::Geometry::wrap_pi(c.pose.rz - peak.pose.rz)) < 2.0 * stepRz;
+            suppressed |= (closeXY && closeRz);
+        }
+        if (!suppressed)
+        {
+            result.push_back(c);
+        }
+    }
+    return result;
+}
+
+std::vector<SearchPeak> GlobalSearch::run(cv::Mat const &referenceFloor, std::vector<cv::Point2f> const &rcsLinePoints, std::vector<float> const &linePointWeights) const
+{
+    int numPoints = rcsLinePoints.size();
+    MRA_TRACE_FUNCTION_INPUTS(numPoints);
+    std::vector<SearchPeak> result;
+    if (numPoints == 0 || _config.gridstepxy() <= 0.0 || _config.gridsteprz() <= 0.0)
+    {
+        return result;
+    }
+
+    // coarse grid search on the top of the pyramid
+    // the amount of evaluations only depends on configuration, not on the input, so runtime is predictable
+    std::vector<cv::Mat> pyramid = createPyramid(referenceFloor);
+    int topLevel = pyramid.size() - 1;
+    double stepXY = _config.gridstepxy();
+    double stepRz = _config.gridsteprz();
+    int nx = (int)(_floorMaxX / stepXY);
+    int ny = (int)(_floorMaxY / stepXY);
+    int nrz = (int)ceil(2.0 * M_PI / stepRz);
+    FitFunction coarse(pyramid.at(topLevel), rcsLinePoints, _ppm / (1 << topLevel));
+    coarse.setWeights(linePointWeights);
+    coarse.setFixedPoint(_fixedPoint);
+    std::vector<SearchPeak> candidates;
+    candidates.reserve((2 * nx + 1) * (2 * ny + 1) * nrz);
+    // bounded: selectPeaks only ever inspects the best numPeaks*45 candidates,
+    // since each selected peak suppresses at most its direct grid neighbors (3x3 in xy, at most 5 in rz due to wrap-around)
+    // so any candidate worse than the current numPeaks*45-th best needs no exact score
+    size_t numRelevant = std::max(1, _config.numpeaks()) * 45;
+    std::priority_queue<double> relevantScores; // max-heap, top is the threshold
+    for (int ix = -nx; ix <= nx; ++ix)
+    {
+        for (int iy = (_symmetry ? 0 : -ny); iy <= ny; ++iy)
+        {
+            if (_symmetry && iy == 0 && ix < 0)
+            {
+                continue; // mirror of a canonical candidate
+            }
+            for (int irz = 0; irz < nrz; ++irz)
+            {
+                double v[3] = {ix * stepXY, iy * stepXY, -M_PI + irz * stepRz};
+                SearchPeak c;
+                c.pose = MRA::Geometry::Pose(v[0], v[1], 0.0, 0.0, 0.0, v[2]);
+                if (_config.bounded())
+                {
+                    double threshold = (relevantScores.size() < numRelevant) ? 2.0 : relevantScores.top();
+                    c.score = coarse.calcBounded(v, threshold);
+                    if (c.score <= threshold)
+                    {
+                        relevantScores.push(c.score);
+                        if (relevantScores.size() > numRelevant)
+                        {
+                            relevantScores.pop();
+                        }
+                    }
+                }
+                else
+                {
+                    c.score = coarse.calc(v);
+                }
+                candidates.push_back(c);
+            }
+        }
+    }
+    int numCandidates = candidates.size();
+    MRA_LOG_DEBUG("global search: evaluated %d coarse candidates at pyramid level %d", numCandidates, topLevel);
+    result = selectPeaks(candidates, stepXY, stepRz);
+
+    // refine the peaks towards full resolution, halving the step at each level
+    // only the direct neighborhood of each peak is evaluated
+    for (int level = topLevel - 1; level >= 0; --level)
+    {
+        stepXY *= 0.5;
+        stepRz *= 0.5;
+        FitFunction fine(pyramid.at(level), rcsLinePoints, _ppm / (1 << level));
+        fine.setWeights(linePointWeights);
+        fine.setFixedPoint(_fixedPoint);
+        for (auto &peak: result)
+        {
+            SearchPeak best = peak;
+            best.score = 2.0; // worse than anything calc can return, so the peak itself is re-scored at this level
+            for (int dx = -1; dx <= 1; ++dx)
+            {
+                for (int dy = -1; dy <= 1; ++dy)
+                {
+                    for (int drz = -1; drz <= 1; ++drz)
+                    {
+                        double v[3] = {peak.pose.x + dx * stepXY, peak.pose.y + dy * stepXY, peak.pose.rz + drz * stepRz};
+                        double score = _config.bounded() ? fine.calcBounded(v, best.score) : fine.calc(v);
+                        if (score < best.score)
+                        {
+                            best.pose = MRA::Geometry::Pose(v[0], v[1], 0.0, 0.0, 0.0, v[2]);
+                            best.score = score;
+                        }
+                    }
+                }
+            }
+            peak = best;
+        }
+    }
+    std::sort(result.begin(), result.end());
+
+    int numPeaks = result.size();
+    MRA_TRACE_FUNCTION_OUTPUT(numPeaks);
+    return result;
+}
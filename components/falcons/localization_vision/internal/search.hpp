@@ -0,0 +1,52 @@
+#ifndef _MRA_FALCONS_LOCALIZATION_VISION_SEARCH_HPP
+#define _MRA_FALCONS_LOCALIZATION_VISION_SEARCH_HPP
+
+#include <opencv2/opencv.hpp>
+#include "geometry.hpp"
+#include "FalconsLocalizationVision_datatypes.hpp"
+
+
+namespace MRA::FalconsLocalizationVision
+{
+
+struct SearchPeak
+{
+    MRA::Geometry::Pose pose;
+    double score = 1.0; // as FitFunction::calc: 0.0 is perfect, 1.0 is worst
+    bool operator<(SearchPeak const &other) const { return score < other.score; }
+}; // struct SearchPeak
+
+
+// global search: exhaustively score a coarse (x,y,rz) grid on a downscaled reference floor,
+// then refine the best peaks level by level towards full resolution
+// the result is intended to seed trackers, which are finetuned by the regular FitAlgorithm
+class GlobalSearch
+{
+public:
+    GlobalSearch(Params const &params);
+    ~GlobalSearch() {};
+
+    std::vector<SearchPeak> run(
+        cv::Mat const &referenceFloor,      // full resolution reference floor
+        std::vector<cv::Point2f> const &rcsLinePoints,
+        std::vector<float> const &linePointWeights) const; // optional, see FitFunction::setWeights
+
+    // step size of the search grid after the final refinement, to be used as tracker step
+    MRA::Geometry::Pose finalStep() const;
+
+private:
+    GlobalSearchParams _config;
+    float _ppm;
+    float _floorMaxX;
+    float _floorMaxY;
+    bool _symmetry = false; // only search the canonical half of the field
+    bool _fixedPoint = false; // see FitFunction::setFixedPoint
+
+    std::vector<cv::Mat> createPyramid(cv::Mat const &referenceFloor) const;
+    std::vector<SearchPeak> selectPeaks(std::vector<SearchPeak> &candidates, double stepXY, double stepRz) const;
+
+}; // class GlobalSearch
+
+} // namespace MRA::FalconsLocalizationVision
+
+#endif
@@ -0,0 +1,206 @@
+#include "shapefield.hpp"
+#include <array>
+#include <limits>
+
+// MRA libraries
+#include "logging.hpp"
+
+using namespace MRA::FalconsLocalizationVision;
+
+
+ShapeField::ShapeField(std::vector<MRA::Datatypes::Shape> const &shapes, AnalyticScoringParams const &config)
+{
+    int numShapes = shapes.size();
+    MRA_TRACE_FUNCTION_INPUTS(numShapes);
+    _config = config;
+    if (_config.gridsize() <= 0.0)
+    {
+        throw std::runtime_error("invalid configuration: analytic.gridSize should be positive (got " + std::to_string(_config.gridsize()) + ")");
+    }
+    _range = std::max(0.0, _config.falloff());
+    for (auto const &s: shapes)
+    {
+        addShape(s);
+    }
+    createIndex();
+    int numPrimitives = _primitives.size();
+    MRA_TRACE_FUNCTION_OUTPUTS(numPrimitives, _numCellsX, _numCellsY);
+}
+
+void ShapeField::addSegment(MRA::Geometry::Point const &a, MRA::Geometry::Point const &b, double halfWidth)
+{
+    Primitive p;
+    p.a = a;
+    p.b = b;
+    p.halfWidth = halfWidth;
+    _primitives.push_back(p);
+}
+
+void ShapeField::addShape(MRA::Datatypes::Shape const &s)
+{
+    // same geometry as drawn by Floor::shapesToCvMat
+    double halfWidth = 0.5 * s.linewidth();
+    if (s.has_line())
+    {
+        addSegment(s.line().from(), s.line().to(), halfWidth);
+    }
+    else if (s.has_circle())
+    {
+        Primitive p;
+        p.isCircle = true;
+        p.a = MRA::Geometry::Point(s.circle().center());
+        p.radius = s.circle().radius();
+        p.halfWidth = halfWidth;
+        _primitives.push_back(p);
+    }
+    else if (s.has_arc())
+    {
+        // cv::ellipse semantics in pixel space, where FCS x and y are flipped (see Floor::pointFcsToPixel)
+        // sample the arc every few degrees, a corner arc then deviates less than a millimeter
+        auto const &arc = s.arc();
+        double sweep = arc.endangle() - arc.startangle();
+        int n = std::max(1, (int)ceil(fabs(sweep) / (5.0 * M_PI / 180.0)));
+        double ca = cos(arc.angle());
+        double sa = sin(arc.angle());
+        MRA::Geometry::Point previous;
+        for (int i = 0; i <= n; ++i)
+        {
+            double t = arc.startangle() + sweep * i / n;
+            double u = arc.size().x() * cos(t) * ca - arc.size().y() * sin(t) * sa;
+            double v = arc.size().x() * cos(t) * sa + arc.size().y() * sin(t) * ca;
+            MRA::Geometry::Point current(arc.center().x() + v, arc.center().y() + u);
+            if (i > 0)
+            {
+                addSegment(previous, current, halfWidth);
+            }
+            previous = current;
+        }
+    }
+    else if (s.has_rectangle())
+    {
+        MRA::Geometry::Point pc(s.rectangle().center());
+        MRA::Geometry::Point hs = MRA::Geometry::Point(s.rectangle().size()) * 0.5;
+        MRA::Geometry::Point corners[4] = {
+            MRA::Geometry::Point(pc.x - hs.x, pc.y - hs.y),
+            MRA::Geometry::Point(pc.x + hs.x, pc.y - hs.y),
+            MRA::Geometry::Point(pc.x + hs.x, pc.y + hs.y),
+            MRA::Geometry::Point(pc.x - hs.x, pc.y + hs.y)
+        };
+        for (int i = 0; i < 4; ++i)
+        {
+            addSegment(corners[i], corners[(i + 1) % 4], halfWidth);
+        }
+    }
+}
+
+void ShapeField::createIndex()
+{
+    MRA_TRACE_FUNCTION();
+    // bounding boxes, extended with linewidth and falloff range
+    std::vector<std::array<double, 4>> boxes; // xmin, ymin, xmax, ymax
+    double xmin = 0.0, ymin = 0.0, xmax = 0.0, ymax = 0.0;
+    for (auto const &p: _primitives)
+    {
+        double margin = p.halfWidth + _range;
+        std::array<double, 4> box;
+        if (p.isCircle)
+        {
+            box = {p.a.x - p.radius, p.a.y - p.radius, p.a.x + p.radius, p.a.y + p.radius};
+        }
+        else
+        {
+            box = {std::min(p.a.x, p.b.x), std::min(p.a.y, p.b.y), std::max(p.a.x, p.b.x), std::max(p.a.y, p.b.y)};
+        }
+        box = {box[0] - margin, box[1] - margin, box[2] + margin, box[3] + margin};
+        xmin = std::min(xmin, box[0]);
+        ymin = std::min(ymin, box[1]);
+        xmax = std::max(xmax, box[2]);
+        ymax = std::max(ymax, box[3]);
+        boxes.push_back(box);
+    }
+    double cell = _config.gridsize();
+    _originX = xmin;
+    _originY = ymin;
+    _numCellsX = 1 + (int)((xmax - xmin) / cell);
+    _numCellsY = 1 + (int)((ymax - ymin) / cell);
+
+    // two passes: count per cell, then fill
+    int numCells = _numCellsX * _numCellsY;
+    std::vector<int> counts(numCells, 0);
+    auto forEachCell = [&](std::array<double, 4> const &box, auto callback)
+    {
+        int ix0 = std::max(0, (int)((box[0] - _originX) / cell));
+        int iy0 = std::max(0, (int)((box[1] - _originY) / cell));
+        int ix1 = std::min(_numCellsX - 1, (int)((box[2] - _originX) / cell));
+        int iy1 = std::min(_numCellsY - 1, (int)((box[3] - _originY) / cell));
+        for (int ix = ix0; ix <= ix1; ++ix)
+        {
+            for (int iy = iy0; iy <= iy1; ++iy)
+            {
+                callback(ix * _numCellsY + iy);
+            }
+        }
+    };
+    for (auto const &box: boxes)
+    {
+        forEachCell(box, [&](int ic) { counts[ic]++; });
+    }
+    _cellStart.assign(numCells + 1, 0);
+    for (int ic = 0; ic < numCells; ++ic)
+    {
+        _cellStart[ic + 1] = _cellStart[ic] + counts[ic];
+    }
+    _cellItems.resize(_cellStart[numCells]);
+    std::vector<int> fill(_cellStart.begin(), _cellStart.end() - 1);
+    for (size_t ip = 0; ip < boxes.size(); ++ip)
+    {
+        forEachCell(boxes[ip], [&](int ic) { _cellItems[fill[ic]++] = ip; });
+    }
+}
+
+double ShapeField::primitiveDistance(Primitive const &p, double x, double y) const
+{
+    double d = 0.0;
+    if (p.isCircle)
+    {
+        d = fabs(hypot(x - p.a.x, y - p.a.y) - p.radius);
+    }
+    else
+    {
+        // project on segment, clamped to its end points
+        double dx = p.b.x - p.a.x;
+        double dy = p.b.y - p.a.y;
+        double len2 = dx * dx + dy * dy;
+        double t = (len2 > 0.0) ? std::max(0.0, std::min(1.0, ((x - p.a.x) * dx + (y - p.a.y) * dy) / len2)) : 0.0;
+        d = hypot(x - (p.a.x + t * dx), y - (p.a.y + t * dy));
+    }
+    return std::max(0.0, d - p.halfWidth);
+}
+
+double ShapeField::distance(double x, double y) const
+{
+    // NO TRACING, this is called for every linepoint in every evaluation
+    int ix = (int)floor((x - _originX) / _config.gridsize());
+    int iy = (int)floor((y - _originY) / _config.gridsize());
+    double result = std::numeric_limits<double>::infinity();
+    if (ix < 0 || iy < 0 || ix >= _numCellsX || iy >= _numCellsY)
+    {
+        return result;
+    }
+    int ic = ix * _numCellsY + iy;
+    for (int i = _cellStart[ic]; i < _cellStart[ic + 1]; ++i)
+    {
+        result = std::min(result, primitiveDistance(_primitives[_cellItems[i]], x, y));
+    }
+    return result;
+}
+
+double ShapeField::score(double x, double y) const
+{
+    double d = distance(x, y);
+    if (_config.falloff() <= 0.0)
+    {
+        return (d <= 0.0) ? 1.0 : 0.0;
+    }
+    return std::max(0.0, 1.0 - d / _config.falloff());
+}
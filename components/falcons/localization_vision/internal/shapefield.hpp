@@ -0,0 +1,58 @@
+#ifndef _MRA_FALCONS_LOCALIZATION_VISION_SHAPEFIELD_HPP
+#define _MRA_FALCONS_LOCALIZATION_VISION_SHAPEFIELD_HPP
+
+#include "geometry.hpp"
+#include "FalconsLocalizationVision_datatypes.hpp"
+
+
+namespace MRA::FalconsLocalizationVision
+{
+
+// analytic field model, alternative to the rasterized reference floor
+// shapes are kept as line segments and circles (arcs are approximated by segments, rectangles split into segments)
+// a uniform grid index keeps the number of distance calculations per lookup small and independent of the field size
+class ShapeField
+{
+public:
+    ShapeField(std::vector<MRA::Datatypes::Shape> const &shapes, AnalyticScoringParams const &config);
+    ~ShapeField() {};
+
+    // distance from point (FCS) to the nearest line edge, 0.0 when on a line
+    // only primitives within falloff range are indexed, beyond that the result may be infinity
+    double distance(double x, double y) const;
+    // score of a point (FCS) in [0.0, 1.0], 1.0 when on a line, falling off linearly to 0.0 in config.falloff
+    double score(double x, double y) const;
+
+    int numPrimitives() const { return _primitives.size(); }
+
+private:
+    struct Primitive
+    {
+        bool isCircle = false;
+        MRA::Geometry::Point a; // segment start, or circle center
+        MRA::Geometry::Point b; // segment end
+        double radius = 0.0;
+        double halfWidth = 0.0;
+    };
+    AnalyticScoringParams _config;
+    double _range = 0.0; // [m] beyond this distance (from line edge) the index does not care about primitives
+    std::vector<Primitive> _primitives;
+
+    // uniform grid, compressed: items of cell i are _cellItems[_cellStart[i]] until _cellItems[_cellStart[i+1]]
+    double _originX = 0.0;
+    double _originY = 0.0;
+    int _numCellsX = 0;
+    int _numCellsY = 0;
+    std::vector<int> _cellStart;
+    std::vector<int> _cellItems;
+
+    void addShape(MRA::Datatypes::Shape const &shape);
+    void addSegment(MRA::Geometry::Point const &a, MRA::Geometry::Point const &b, double halfWidth);
+    void createIndex();
+    double primitiveDistance(Primitive const &p, double x, double y) const;
+
+}; // class ShapeField
+
+} // namespace MRA::FalconsLocalizationVision
+
+#endif
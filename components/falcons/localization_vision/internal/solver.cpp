@@ -1,10 +1,14 @@
 #include "solver.hpp"
 #include "guessing.hpp"
+#include "search.hpp"
+#include "linepoints.hpp"
 
 // MRA libraries
 #include "geometry.hpp"
 #include "opencv_utils.hpp"
 #include "logging.hpp"
+#include <google/protobuf/util/time_util.h>
+#include <chrono>
 
 
 using namespace MRA::FalconsLocalizationVision;
@@ -27,6 +31,13 @@ void Solver::configure(Params const &p)
     // configure helper classes
     _floor.configure(_params);
     _fitAlgorithm.configure(_params.solver());
+    // analytic field model is cheap to create, unlike the reference floor
+    _shapeField.reset();
+    if (_params.solver().scoring() == ScoringEnum::ANALYTIC)
+    {
+        _shapeField = std::make_shared<ShapeField const>(createShapes(), _params.solver().analytic());
+    }
+    _fitAlgorithm.setShapeField(_shapeField);
     // trigger re-init
     _reinit = true;
 }
@@ -77,10 +88,22 @@ void Solver::setState(State const &s)
     _state = s;
 }
 
+void Solver::setState(State &&s)
+{
+    MRA_TRACE_FUNCTION();
+    _state = std::move(s);
+}
+
+void Solver::setTimestamp(google::protobuf::Timestamp const &ts)
+{
+    MRA_TRACE_FUNCTION();
+    _timestamp = ts;
+}
+
 void Solver::setInput(Input const &in)
 {
     MRA_TRACE_FUNCTION_INPUTS(in);
-    _input = in;
+    _input = &in;
 }
 
 cv::Mat Solver::createReferenceFloorMat(float blurFactor) const
@@ -93,79 +116,129 @@ cv::Mat Solver::createReferenceFloorMat(float blurFactor) const
     // serialize and store the mat in state, as this should not be recalculated each tick
     // some external python plot tool should be able to plot it
 
-    // determine set of shapes
-    std::vector<MRA::Datatypes::Shape> shapes(_params.shapes().begin(), _params.shapes().end());
-    if (_params.has_model())
-    {
-        _floor.letterModelToShapes(_params.model(), shapes); // TODO: move this to MRA::libraries? could be useful elsewhere
-    }
-
     // create cv::Mat such that field is rotated screen-friendly: more columns than rows
     result = _floor.createMat();
-    _floor.shapesToCvMat(shapes, blurFactor, result);
+    _floor.shapesToCvMat(createShapes(), blurFactor, result);
 
     return result;
 }
 
+std::vector<MRA::Datatypes::Shape> Solver::createShapes() const
+{
+    MRA_TRACE_FUNCTION();
+    // letter model and optional custom shapes
+    std::vector<MRA::Datatypes::Shape> result(_params.shapes().begin(), _params.shapes().end());
+    if (_params.has_model())
+    {
+        _floor.letterModelToShapes(_params.model(), result); // TODO: move this to MRA::libraries? could be useful elsewhere
+    }
+    return result;
+}
+
 void Solver::reinitialize()
 {
     MRA_TRACE_FUNCTION();
     // first check the flag
     if (!_reinit) return;
 
-    // check if (re)calculation is needed based on state
-    // if not (cache_hit), then deserialize from state and done,
-    // if yes then calculate using params
+    // the reference floor and distance field in state are derived from the params in state
+    // if those differ, drop them and store the params, so they are calculated again when needed
     std::string stateParamsStr, paramsStr;
     _state.params().SerializeToString(&stateParamsStr);
     _params.SerializeToString(&paramsStr);
-    bool cache_hit = (stateParamsStr == paramsStr) && _state.has_referencefloor();
-    if (cache_hit)
+    if (stateParamsStr != paramsStr)
     {
-        MRA::OpenCVUtils::deserializeCvMat(_state.referencefloor(), _referenceFloorMat);
-        return;
+        _state.clear_referencefloor();
+        _state.clear_distancefield();
+        _state.mutable_params()->CopyFrom(_params);
     }
 
-    MRA_LOG_DEBUG("cache miss, creating reference floor");
+    // analytic scoring does not need the reference floor, then it is only created when global search or diagnostics need it
+    if (_params.solver().scoring() != ScoringEnum::ANALYTIC || _params.solver().optimizer() == OptimizerEnum::LEVENBERG_MARQUARDT)
+    {
+        initializeReferenceFloor();
+    }
+}
 
-    // calculate reference floor and store in state as protobuf CvMatProto object for next iteration (via state)
-    _referenceFloorMat = createReferenceFloorMat(_params.solver().blurfactor());
-    MRA::OpenCVUtils::serializeCvMat(_referenceFloorMat, *_state.mutable_referencefloor());
+void Solver::initializeReferenceFloor()
+{
+    MRA_TRACE_FUNCTION();
+    if (!_referenceFloorMat.empty())
+    {
+        return;
+    }
+
+    // if cached in state, then use the floor from state (zero-copy view on the state bytes),
+    // otherwise calculate using params and store in state as protobuf CvMatProto object for next iteration (via state)
+    // after that, only the copy in state is kept
+    if (!_state.has_referencefloor())
+    {
+        MRA_LOG_DEBUG("cache miss, creating reference floor");
+        cv::Mat floor = createReferenceFloorMat(_params.solver().blurfactor());
+        floor.copyTo(MRA::OpenCVUtils::allocateCvMat(floor.rows, floor.cols, floor.type(), *_state.mutable_referencefloor()));
+        _state.clear_distancefield(); // derived from the previous reference floor
+    }
+    _referenceFloorMat = MRA::OpenCVUtils::wrapCvMat(_state.referencefloor());
+    reinitializeDistanceField();
+}
 
-    // store params into state
-    _state.mutable_params()->CopyFrom(_params);
+void Solver::reinitializeDistanceField()
+{
+    MRA_TRACE_FUNCTION();
+    // the distance field only depends on the reference floor, pixelsPerMeter and distanceClip, which are all covered by the params in state
+    // so it is kept in state next to the reference floor, and only (re)calculated when that is recalculated
+    _distanceFieldMat.release();
+    if (_params.solver().optimizer() == OptimizerEnum::LEVENBERG_MARQUARDT)
+    {
+        if (!_state.has_distancefield())
+        {
+            MRA_LOG_DEBUG("cache miss, creating distance field");
+            cv::Mat field = DistanceFitFunction::createDistanceField(_referenceFloorMat, _params.solver().pixelspermeter(), _params.solver().levenbergmarquardt().distanceclip());
+            field.copyTo(MRA::OpenCVUtils::allocateCvMat(field.rows, field.cols, field.type(), *_state.mutable_distancefield()));
+            _diag.mutable_timing()->set_distancefieldcreated(true);
+        }
+        _distanceFieldMat = MRA::OpenCVUtils::wrapCvMat(_state.distancefield());
+    }
+    _fitAlgorithm.setDistanceField(_distanceFieldMat);
 }
 
 std::vector<cv::Point2f> Solver::createLinePoints() const
 {
     MRA_TRACE_FUNCTION();
+    int numPacked = _input->landmarkspacked_size();
+    if (numPacked % 2)
+    {
+        throw std::runtime_error("invalid input: landmarksPacked should contain (x,y) pairs (got " + std::to_string(numPacked) + " values)");
+    }
     std::vector<cv::Point2f> result;
-    for (const Landmark& landmark : _input.landmarks())
+    result.reserve(_input->landmarks_size() + numPacked / 2);
+    for (const Landmark& landmark : _input->landmarks())
     {
         float x = landmark.x();
         float y = landmark.y();
         cv::Point2f lp(x, y);
         result.push_back(lp);
     }
+    // the packed floats are (x,y) pairs, read straight from the input
+    float const *packed = _input->landmarkspacked().data();
+    for (int it = 0; it < numPacked; it += 2)
+    {
+        result.emplace_back(packed[it], packed[it + 1]);
+    }
     int n = result.size();
     MRA_TRACE_FUNCTION_OUTPUT(n);
     return result;
 }
 
-std::vector<Tracker> Solver::createTrackers() const
+std::vector<Tracker> Solver::createTrackers()
 {
     MRA_TRACE_FUNCTION();
     std::vector<Tracker> result;
 
-    // load from state
-    for (auto const &st: _state.trackers())
-    {
-        result.push_back(Tracker(_params, st));
-    }
-
-    // state trackers are sorted by descending quality, so the first tracker is expected to be the best one
-    // given input guess is intended to finetune, taking action radius into account
-    // offset the input guess to ensure that it is included,
+    // load from state: warm-start around previous fit results, with the (small) action radius as step
+    // state trackers are sorted by descending quality
+    // given input guess is intended to finetune, taking action radius into account, so it gets its own tracker
+    // offset each guess to ensure that it is included,
     // since by default the generated simplex would not hit it
     //     if the step is configured to be (sx,sy,srz) and initial guess is zero
     //     then the initial simplex evaluates at the following simplex:
@@ -173,16 +246,38 @@ std::vector<Tracker> Solver::createTrackers() const
     //         ( 0.5*sx,       0,        0)
     //         (      0,  0.5*sy,        0)
     //         (      0,       0,  0.5*srz)
-    if (result.size() == 0)
+    if (_input->has_guess() || _state.trackers_size() == 0)
+    {
+        Tracker tracker(_params, TrackerState());
+        tracker.guess = _input->guess();
+        tracker.guess.rz -= 0.5 * tracker.step.rz;
+        result.push_back(tracker);
+    }
+    for (auto const &st: _state.trackers())
+    {
+        Tracker tracker(_params, st);
+        tracker.guess.rz -= 0.5 * tracker.step.rz;
+        result.push_back(tracker);
+    }
+
+    // without prior (first tick, or neither input guess nor persisted trackers), run the global search to add trackers at the best peaks
+    bool noPrior = (_state.tick() == 0) || (!_input->has_guess() && _state.trackers_size() == 0);
+    if (_params.solver().globalsearch().enabled() && noPrior)
     {
-        result.push_back(Tracker(_params, TrackerState()));
+        initializeReferenceFloor();
+        GlobalSearch gs(_params);
+        for (auto const &peak: gs.run(_referenceFloorMat, _linePoints, _linePointWeights))
+        {
+            Tracker tr(_params, TrackerState());
+            tr.step = gs.finalStep();
+            tr.guess = peak.pose;
+            tr.guess.rz -= 0.5 * tr.step.rz; // same simplex offset as applied on input guess
+            result.push_back(tr);
+        }
     }
-    Tracker &tracker = result.at(0);
-    tracker.guess = _input.guess();
-    tracker.guess.rz -= 0.5 * tracker.step.rz;
 
     // run the guesser to add more attempts/trackers
-    Guesser g(_params);
+    Guesser g(_params, _state.tick());
     bool initial = (_state.tick() == 0);
     g.run(result, initial);
 
@@ -193,13 +288,19 @@ void Solver::runFitUpdateTrackers()
 {
     MRA_TRACE_FUNCTION();
     // run the fit algorithm (multithreaded, one per tracker) and update trackers
-    _fitAlgorithm.run(_referenceFloorMat, _linePoints, _trackers);
+    _fitAlgorithm.run(_referenceFloorMat, _linePoints, _linePointWeights, _trackers);
+    int evaluations = 0;
+    for (auto const &tr: _trackers)
+    {
+        evaluations += tr.fitEvaluations;
+    }
+    _diag.mutable_timing()->set_evaluations(evaluations);
 
     // set _fitResult
     _fitResult.valid = false;
     if (_trackers.size())
     {
-        auto tr = _trackers.at(0);
+        auto const &tr = _trackers.at(0);
         _fitResult.valid = tr.fitValid;
         _fitResult.pose = tr.fitResult;
         _fitResult.score = tr.fitScore;
@@ -210,13 +311,119 @@ void Solver::runFitUpdateTrackers()
             c.mutable_pose()->CopyFrom((MRA::Datatypes::Pose)_fitResult.pose);
             c.set_confidence(_fitResult.score);
             *_output.add_candidates() = c;
+            // the mirrored twin has the exact same score, it is up to worldModel to disambiguate
+            if (_params.solver().symmetry())
+            {
+                c.mutable_pose()->CopyFrom((MRA::Datatypes::Pose)mirrorPose(_fitResult.pose));
+                c.set_mirrored(true);
+                *_output.add_candidates() = c;
+            }
         }
     }
+
+    // keep the good trackers for next tick
+    cleanupBadTrackers();
+    persistTrackers();
 }
 
 void Solver::cleanupBadTrackers()
+{
+    int numTrackers = _trackers.size();
+    MRA_TRACE_FUNCTION_INPUTS(numTrackers);
+    auto config = _params.solver().trackers();
+    // trackers are sorted by decreasing quality, so when merging, the best one survives
+    // it inherits the oldest creation time and id, so a converged tracker keeps its identity
+    std::vector<Tracker> result;
+    for (auto &tr: _trackers)
+    {
+        if (!tr.fitValid)
+        {
+            continue;
+        }
+        // with symmetry, trackers converged to mirrored poses are duplicates, keep all of them in the canonical half
+        if (_params.solver().symmetry())
+        {
+            tr.fitResult = canonicalPose(tr.fitResult);
+        }
+        // new trackers (not yet persisted, see persistTrackers) start their lifecycle now (if confident),
+        // existing ones are only refreshed when confident
+        if (tr.id == 0)
+        {
+            if (tr.confidence() < config.minconfidence())
+            {
+                continue;
+            }
+            tr.creation = _timestamp;
+            tr.lastActive = _timestamp;
+        }
+        else if (tr.confidence() >= config.minconfidence())
+        {
+            tr.lastActive = _timestamp;
+        }
+        // expire stale trackers
+        double age = google::protobuf::util::TimeUtil::DurationToMilliseconds(_timestamp - tr.lastActive) * 1e-3;
+        if (age > config.timeout())
+        {
+            continue;
+        }
+        // merge duplicates
+        bool merged = false;
+        for (auto &other: result)
+        {
+            bool closeXY = (MRA::Geometry::Point(tr.fitResult) - MRA::Geometry::Point(other.fitResult)).size() < config.mergedistancexy();
+            bool closeRz = fabs(MRA::Geometry::wrap_pi(tr.fitResult.rz - other.fitResult.rz)) < config.mergedistancerz();
+            if (closeXY && closeRz)
+            {
+                if (tr.id && (other.id == 0 || tr.creation < other.creation))
+                {
+                    other.id = tr.id;
+                    other.creation = tr.creation;
+                }
+                merged = true;
+                break;
+            }
+        }
+        if (!merged)
+        {
+            result.push_back(tr);
+        }
+    }
+    _trackers = result;
+    numTrackers = _trackers.size();
+    MRA_TRACE_FUNCTION_OUTPUT(numTrackers);
+}
+
+void Solver::persistTrackers()
 {
     MRA_TRACE_FUNCTION();
+    // store the best trackers into state, for warm-starting next tick
+    // newly created trackers get a fresh id (id 0 is reserved for 'not yet persisted')
+    int maxId = 0;
+    for (auto const &tr: _trackers)
+    {
+        maxId = std::max(maxId, tr.id);
+    }
+    _state.clear_trackers();
+    int maxCount = std::max(0, _params.solver().trackers().maxcount());
+    for (auto &tr: _trackers)
+    {
+        if (_state.trackers_size() >= maxCount)
+        {
+            break;
+        }
+        if (tr.id == 0)
+        {
+            tr.id = ++maxId;
+        }
+        TrackerState *st = _state.add_trackers();
+        st->mutable_pose()->CopyFrom((MRA::Datatypes::Pose)tr.fitResult);
+        *st->mutable_creation() = tr.creation;
+        *st->mutable_lastactive() = tr.lastActive;
+        st->set_id(tr.id);
+        st->set_confidence(tr.confidence());
+    }
+    int numPersisted = _state.trackers_size();
+    MRA_TRACE_FUNCTION_OUTPUT(numPersisted);
 }
 
 // TODO move to opencv_utils?
@@ -234,19 +441,32 @@ void combineImages(cv::Mat m, cv::Mat m_other)
     m += tmp;
 }
 
-cv::Mat Solver::createDiagnosticsMat() const
+cv::Mat Solver::createDiagnosticsMat(float scale) const
 {
-    MRA_TRACE_FUNCTION();
+    MRA_TRACE_FUNCTION_INPUTS(scale);
     // reference floor either with or without blur
     bool withBlur = true;
     cv::Mat referenceFloorMat = withBlur ? _referenceFloorMat : createReferenceFloorMat();
 
+    // optionally render at reduced resolution, by drawing on a floor with less pixels per meter
+    float ppm = _params.solver().pixelspermeter();
+    Floor floor = _floor;
+    if (scale > 0.0 && scale < 1.0)
+    {
+        ppm *= scale;
+        Params scaledParams = _params;
+        scaledParams.mutable_solver()->set_pixelspermeter(ppm);
+        floor.configure(scaledParams);
+        cv::Mat scaledFloorMat = floor.createMat();
+        cv::resize(referenceFloorMat, scaledFloorMat, scaledFloorMat.size(), 0, 0, cv::INTER_AREA);
+        referenceFloorMat = scaledFloorMat;
+    }
+
     // create diagnostics floor, upscale to colors
     cv::Mat result;
     cv::cvtColor(referenceFloorMat, result, cv::COLOR_GRAY2BGR);
 
     // add linepoints with blue/cyan color
-    float ppm = _params.solver().pixelspermeter();
     FitFunction ff(referenceFloorMat, _linePoints, ppm);
     std::vector<cv::Point2f> transformed = ff.transformPoints(_linePoints, ff.transformationMatrixRCS2FCS(_fitResult.pose.x, _fitResult.pose.y, _fitResult.pose.rz));
     MRA_LOG_DEBUG("number of transformed points: %d", (int)transformed.size());
@@ -271,13 +491,13 @@ cv::Mat Solver::createDiagnosticsMat() const
     MRA::Geometry::Position robotPoint(_fitResult.pose);
     MRA::Geometry::Position directionOffset = MRA::Geometry::Position(0.0, 0.4, 0.0); // point towards y direction (where the robot is aiming at)
     MRA::Geometry::Position directionPoint = directionOffset.transformRcsToFcs(robotPoint);
-    cv::circle(result, _floor.pointFcsToPixel(robotPoint), ppm * 0.28, color, linewidth);
-    cv::circle(result, _floor.pointFcsToPixel(directionPoint), ppm * 0.04, color, linewidth);
-    cv::line(result, _floor.pointFcsToPixel(robotPoint), _floor.pointFcsToPixel(directionPoint), color, linewidth);
+    cv::circle(result, floor.pointFcsToPixel(robotPoint), ppm * 0.28, color, linewidth);
+    cv::circle(result, floor.pointFcsToPixel(directionPoint), ppm * 0.04, color, linewidth);
+    cv::line(result, floor.pointFcsToPixel(robotPoint), floor.pointFcsToPixel(directionPoint), color, linewidth);
 
     // add green grid lines on top (all 1 pixel, so we can clearly see how the field lines are positioned)
-    _floor.addGridLines(result, 1.0, cv::Scalar(0, 100, 0)); // 1meter grid: very faint
-    _floor.addGridLines(result, 2.0, cv::Scalar(0, 255, 0)); // 2meter grid: bright, more prominent
+    floor.addGridLines(result, 1.0, cv::Scalar(0, 100, 0)); // 1meter grid: very faint
+    floor.addGridLines(result, 2.0, cv::Scalar(0, 255, 0)); // 2meter grid: bright, more prominent
 
     return result;
 }
@@ -285,15 +505,30 @@ cv::Mat Solver::createDiagnosticsMat() const
 void Solver::dumpDiagnosticsMat()
 {
     MRA_TRACE_FUNCTION();
-    MRA::OpenCVUtils::serializeCvMat(createDiagnosticsMat(), *_diag.mutable_floor());
+    // rendering and serializing the image is expensive, so only do it when so configured
+    if (!_params.debug())
+    {
+        return;
+    }
+    int interval = _params.diagnostics().interval();
+    if (interval > 1 && (_state.tick() % interval) != 0)
+    {
+        return;
+    }
+    initializeReferenceFloor();
+    MRA::OpenCVUtils::serializeCvMat(createDiagnosticsMat(_params.diagnostics().scale()), *_diag.mutable_floor());
 }
 
 void Solver::manualMode()
 {
     MRA_TRACE_FUNCTION();
     float ppm = _params.solver().pixelspermeter();
-    // run the core calc() function
-    FalconsLocalizationVision::FitFunction fit(_referenceFloorMat, _linePoints, ppm);
+    // run the core calc() function, always record the (single point) path for plotting
+    bool recordPath = true;
+    FalconsLocalizationVision::FitFunction fit(_referenceFloorMat, _linePoints, ppm, recordPath);
+    fit.setWeights(_linePointWeights);
+    fit.setShapeField(_shapeField);
+    fit.setFixedPoint(_params.solver().fixedpoint());
     double pose[3] = {_params.solver().manual().pose().x(), _params.solver().manual().pose().y(), _params.solver().manual().pose().rz()};
     double score = fit.calc(pose);
     // copy pose into _fitResult so local.floor will be properly created
@@ -308,10 +543,20 @@ void Solver::manualMode()
     *_output.add_candidates() = c;
 }
 
+// wall clock seconds since given start, for Local timing
+static double elapsed(std::chrono::steady_clock::time_point const &start)
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
 int Solver::run()
 {
     int tick = _state.tick();
     MRA_TRACE_FUNCTION_INPUTS(tick);
+    if (_input == nullptr)
+    {
+        throw std::runtime_error("no input given, see setInput");
+    }
     // try to keep the design as simple as possible: minimize state, trackers over time (that is for worldModel to handle)
     // initially (and maybe also occasionally?) we should perhaps do some kind of grid search
     // that is handled in the FitAlgorithm, also optional multithreading and guessing / search space partitioning
@@ -319,11 +564,19 @@ int Solver::run()
     // the FitCore is a single fit operation (which uses opencv Downhill Simplex solver):
     // fit given white pixels and initial guess to the reference field
 
+    // each phase is timed into Local, see test/benchmark.cpp
+    Timing *timing = _diag.mutable_timing();
+    auto t = std::chrono::steady_clock::now();
+
     // create or get the cached reference floor
     reinitialize();
+    timing->set_reinitialize(elapsed(t));
 
     // create a floor (linePoints RCS, robot at (0,0,0)) for input linepoints
+    t = std::chrono::steady_clock::now();
     _linePoints = createLinePoints();
+    LinePointPreprocessor(_params).run(_linePoints, _linePointWeights);
+    timing->set_createlinepoints(elapsed(t));
 
     // check for any linepoints
     // (having none at all is very unusual for a real robot, but not so much in test suite)
@@ -338,15 +591,21 @@ int Solver::run()
         {
             // regular mode, based on trackers
             // setup trackers: existing from state and new from guessing configuration
+            t = std::chrono::steady_clock::now();
             _trackers = createTrackers();
+            timing->set_createtrackers(elapsed(t));
 
             // run the fit algorithm (multithreaded), update trackers, update _fitResult
+            t = std::chrono::steady_clock::now();
             runFitUpdateTrackers();
+            timing->set_fit(elapsed(t));
         }
     }
 
-    // create and optionally dump of diagnostics data for plotting
+    // optional dump of diagnostics data for plotting
+    t = std::chrono::steady_clock::now();
     dumpDiagnosticsMat();
+    timing->set_diagnostics(elapsed(t));
 
     // prepare for next tick
     _state.set_tick(1 + _state.tick());
@@ -365,6 +624,15 @@ Local const &Solver::getDiagnostics() const
     return _diag;
 }
 
+State Solver::releaseState()
+{
+    MRA_TRACE_FUNCTION();
+    _referenceFloorMat.release(); // it refers to the state bytes
+    _distanceFieldMat.release(); // idem
+    _fitAlgorithm.setDistanceField(_distanceFieldMat);
+    return std::move(_state);
+}
+
 State const &Solver::getState() const
 {
     return _state;
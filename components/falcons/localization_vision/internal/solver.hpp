@@ -17,16 +17,20 @@ public:
 
     void configure(Params const &p);
     void setState(State const &s);
-    void setInput(Input const &in);
+    void setState(State &&s); // avoids copying the (multi-megabyte) reference floor
+    void setInput(Input const &in); // not copied, so the input must outlive run()
+    void setTimestamp(google::protobuf::Timestamp const &ts); // needed for tracker lifecycle
 
     int run();
 
     Output const &getOutput() const;
     Local const &getDiagnostics() const;
     State const &getState() const;
+    State releaseState(); // move the state out, to avoid copying; the solver is not to be used afterwards
 
 private:
-    Input  _input;
+    Input const *_input = nullptr;
+    google::protobuf::Timestamp _timestamp;
     Params _params;
     State  _state;
     Output _output;
@@ -45,28 +49,37 @@ private:
 
     // reference floor: calculate once, based on letter model and optional extra shapes
     cv::Mat _referenceFloorMat;
+    // distance field of the reference floor, only for Levenberg-Marquardt, cached in state likewise
+    cv::Mat _distanceFieldMat;
+    // alternative analytic field model, only when so configured
+    std::shared_ptr<ShapeField const> _shapeField;
 public:
     cv::Mat createReferenceFloorMat(float blurFactor = 0.0) const;
+    std::vector<MRA::Datatypes::Shape> createShapes() const;
 
 private:
     // initialization (a bit expensive), only once, or when parameters change
     bool _reinit = false;
     void reinitialize();
+    void initializeReferenceFloor(); // on first use, not needed for analytic scoring
+    void reinitializeDistanceField();
 
     // input linepoints: calculate each tick, based on input landmarks / linepoints
     std::vector<cv::Point2f> _linePoints;
+    std::vector<float> _linePointWeights; // empty unless distance weighting is configured
     std::vector<cv::Point2f> createLinePoints() const;
 
     // setup trackers: existing ones from state and new ones from guessing configuration
     std::vector<Tracker> _trackers;
-    std::vector<Tracker> createTrackers() const;
+    std::vector<Tracker> createTrackers();
 
     // run the fit algorithm (multithreaded) and update trackers
     void runFitUpdateTrackers();
-    void cleanupBadTrackers();
+    void cleanupBadTrackers(); // drop invalid and expired trackers, merge duplicates
+    void persistTrackers(); // store the best trackers into state
 
     // optional debug data export
-    cv::Mat createDiagnosticsMat() const;
+    cv::Mat createDiagnosticsMat(float scale = 1.0) const;
     void dumpDiagnosticsMat();
 
     // manual mode for tuning
@@ -1,4 +1,5 @@
 #include "tracker.hpp"
+#include <cmath>
 
 using namespace MRA::FalconsLocalizationVision;
 
@@ -22,6 +23,22 @@ Tracker::Tracker(Params const &params, TrackerState const &st)
 
 float Tracker::confidence() const
 {
-    return 1.0; // TODO
+    // TODO: also take age and freshness into account
+    if (!fitValid)
+    {
+        return 0.0;
+    }
+    return 1.0 - fitScore;
 }
 
+
+MRA::Geometry::Pose MRA::FalconsLocalizationVision::mirrorPose(MRA::Geometry::Pose const &pose)
+{
+    return MRA::Geometry::Pose(-pose.x, -pose.y, pose.z, pose.rx, pose.ry, MRA::Geometry::wrap_pi(pose.rz + M_PI));
+}
+
+MRA::Geometry::Pose MRA::FalconsLocalizationVision::canonicalPose(MRA::Geometry::Pose const &pose)
+{
+    bool canonical = (pose.y > 0.0) || (pose.y == 0.0 && pose.x >= 0.0);
+    return canonical ? pose : mirrorPose(pose);
+}
@@ -25,16 +25,22 @@ public:
 
     // fit result, which is filled in by FitAlgorithm::run
     MRA::Geometry::Pose fitResult;
-    bool fitValid;
-    float fitScore;
+    bool fitValid = false;
+    float fitScore = 1.0; // as FitFunction::calc: 0.0 is perfect
     std::vector<MRA::Geometry::Pose> fitPath;
+    int fitEvaluations = 0;
 
     // score heuristic: combine fitScore, age and freshness
     float confidence() const;
-    bool operator<(Tracker const &other) { return confidence() > other.confidence(); }
+    bool operator<(Tracker const &other) const { return confidence() > other.confidence(); }
 
 }; // class Tracker
 
+// the field is point-symmetric: pose (x,y,rz) scores identical to its mirror (-x,-y,rz+pi)
+// the canonical half is y > 0, or y == 0 and x >= 0
+MRA::Geometry::Pose mirrorPose(MRA::Geometry::Pose const &pose);
+MRA::Geometry::Pose canonicalPose(MRA::Geometry::Pose const &pose);
+
 } // namespace MRA::FalconsLocalizationVision
 
 #endif
@@ -12,12 +12,17 @@ using namespace ::testing;
 #include <fstream>
 #include <opencv2/opencv.hpp>
 #include "opencv_utils.hpp"
+#include <google/protobuf/util/time_util.h>
 
 // System under test:
 #include "FalconsLocalizationVision.hpp"
 #include "fit.hpp" // internal actually
 #include "floor.hpp" // internal actually
 #include "solver.hpp" // internal actually
+#include "guessing.hpp" // internal actually
+#include "linepoints.hpp" // internal actually
+#include "shapefield.hpp" // internal actually
+#include "search.hpp" // internal actually
 using namespace MRA;
 
 // Basic tick shall run OK and return error_value 0.
@@ -82,6 +87,36 @@ TEST(FalconsLocalizationVisionTest, referenceFloor)
     EXPECT_EQ(pixel_count, 117051);
 }
 
+// Diagnostics floor is only rendered when debug is enabled, optionally at reduced resolution
+TEST(FalconsLocalizationVisionTest, diagnosticsFloor)
+{
+    MRA_TRACE_TEST_FUNCTION();
+    // Arrange
+    auto m = FalconsLocalizationVision::FalconsLocalizationVision();
+    auto input = FalconsLocalizationVision::Input();
+    auto params = m.defaultParams();
+    auto state = FalconsLocalizationVision::State();
+    auto outputNoDebug = FalconsLocalizationVision::Output();
+    auto localNoDebug = FalconsLocalizationVision::Local();
+    auto outputDebug = FalconsLocalizationVision::Output();
+    auto localDebug = FalconsLocalizationVision::Local();
+
+    // Act
+    params.set_debug(false);
+    int error_value1 = m.tick(input, params, state, outputNoDebug, localNoDebug);
+    params.set_debug(true);
+    params.mutable_diagnostics()->set_scale(0.5);
+    int error_value2 = m.tick(input, params, state, outputDebug, localDebug);
+
+    // Assert
+    EXPECT_EQ(error_value1, 0);
+    EXPECT_EQ(error_value2, 0);
+    EXPECT_FALSE(localNoDebug.has_floor());
+    EXPECT_TRUE(localDebug.has_floor());
+    EXPECT_EQ(localDebug.floor().width(), state.referencefloor().width() / 2);
+    EXPECT_EQ(localDebug.floor().height(), state.referencefloor().height() / 2);
+}
+
 // Template for testing calculation/scoring function - 0.0 is perfect, 1.0 is worst
 double FalconsLocalizationVisionTestCalc(std::vector<cv::Point2f> const &points, double x, double y, double rz)
 {
@@ -278,6 +313,617 @@ TEST(FalconsLocalizationVisionTest, jsonTest3GrabsR5BadInit)
     auto output = TestFactory::run_testvector<FalconsLocalizationVision::FalconsLocalizationVision>(std::string("components/falcons/localization_vision/testdata/test3_grabs_r5_20191219_210335_bad_init.json"), tolerance);
 }
 
+// Guessing is disabled by default: configure four initial quadrant guesses and one random guess per tick
+void configureGuessing(FalconsLocalizationVision::Params &params)
+{
+    auto guessing = params.mutable_solver()->mutable_guessing();
+    for (double x: {-4.0, 4.0})
+    {
+        for (double y: {-4.0, 4.0})
+        {
+            auto circle = guessing->add_initial();
+            circle->mutable_center()->set_x(x);
+            circle->mutable_center()->set_y(y);
+            circle->set_radius(5.0);
+        }
+    }
+    guessing->mutable_random()->set_count(1);
+}
+
+// Guessing: initial guesses only at first tick, random guesses reproducible and not too close to existing trackers
+TEST(FalconsLocalizationVisionTest, guesser)
+{
+    MRA_TRACE_TEST_FUNCTION();
+    // Arrange
+    auto params = FalconsLocalizationVision::defaultParams();
+    configureGuessing(params);
+    auto rgParams = params.solver().guessing().random();
+    int numInitial = params.solver().guessing().initial_size();
+    std::vector<FalconsLocalizationVision::Tracker> trackers1(1, FalconsLocalizationVision::Tracker(params, FalconsLocalizationVision::TrackerState()));
+    std::vector<FalconsLocalizationVision::Tracker> trackers2 = trackers1;
+    std::vector<FalconsLocalizationVision::Tracker> trackers3 = trackers1;
+
+    // Act
+    FalconsLocalizationVision::Guesser(params, 0).run(trackers1, true);
+    FalconsLocalizationVision::Guesser(params, 0).run(trackers2, true);
+    FalconsLocalizationVision::Guesser(params, 1).run(trackers3, false);
+
+    // Assert
+    EXPECT_EQ((int)trackers1.size(), 1 + numInitial + rgParams.count());
+    EXPECT_EQ((int)trackers3.size(), 1 + rgParams.count());
+    ASSERT_EQ(trackers1.size(), trackers2.size());
+    for (size_t it = 0; it < trackers1.size(); ++it)
+    {
+        EXPECT_EQ(trackers1[it].guess.x, trackers2[it].guess.x);
+        EXPECT_EQ(trackers1[it].guess.y, trackers2[it].guess.y);
+        for (size_t other = 0; other < it; ++other)
+        {
+            double distance = (MRA::Geometry::Point(trackers1[it].guess) - MRA::Geometry::Point(trackers1[other].guess)).size();
+            EXPECT_GE(distance, rgParams.exclusionradius());
+        }
+    }
+}
+
+// Load only the input landmarks from a json test vector
+FalconsLocalizationVision::Input loadTestVectorInput(std::string filename)
+{
+    auto result = FalconsLocalizationVision::Input();
+    nlohmann::json j = nlohmann::json::parse(read_file_as_string(filename));
+    convert_json_to_proto(j, "Input", result);
+    return result;
+}
+
+// Check that a candidate pose matches the expected pose, or its point-symmetric twin
+void expectPoseOrMirror(MRA::Datatypes::Pose const &actual, MRA::Geometry::Pose const &expected, double tolXY, double tolRz)
+{
+    MRA::Geometry::Pose mirrored(-expected.x, -expected.y, 0.0, 0.0, 0.0, expected.rz + M_PI);
+    bool match = false;
+    for (auto const &p: {expected, mirrored})
+    {
+        match |= (fabs(actual.x() - p.x) < tolXY && fabs(actual.y() - p.y) < tolXY && fabs(MRA::Geometry::wrap_pi(actual.rz() - p.rz)) < tolRz);
+    }
+    EXPECT_TRUE(match) << "actual pose (" << actual.x() << ", " << actual.y() << ", " << actual.rz() << ")";
+}
+
+// Reference floor cache in state: handed over to and from the solver without copying, with the same result as copying
+TEST(FalconsLocalizationVisionTest, referenceFloorZeroCopy)
+{
+    MRA_TRACE_TEST_FUNCTION();
+    // Arrange
+    auto m = FalconsLocalizationVision::FalconsLocalizationVision();
+    auto input = loadTestVectorInput("components/falcons/localization_vision/testdata/test2_shift_xy.json");
+    auto params = m.defaultParams();
+    auto t1 = google::protobuf::util::TimeUtil::MillisecondsToTimestamp(1000);
+    auto t2 = google::protobuf::util::TimeUtil::MillisecondsToTimestamp(1100);
+    auto state = FalconsLocalizationVision::State();
+    auto output = FalconsLocalizationVision::Output();
+    auto local = FalconsLocalizationVision::Local();
+    EXPECT_EQ(m.tick(t1, input, params, state, output, local), 0); // creates the reference floor
+    auto stateCopy = state;
+    char const *floorBuffer = state.referencefloor().data().data();
+    FalconsLocalizationVision::Solver solver;
+    solver.configure(params);
+    solver.setTimestamp(t2);
+    solver.setInput(input);
+
+    // Act
+    int error_value = m.tick(t2, input, params, state, output, local); // moves state in and out
+    solver.setState(stateCopy); // copies state in
+    int error_value_copy = solver.run();
+    cv::Mat wrapped = MRA::OpenCVUtils::wrapCvMat(state.referencefloor());
+
+    // Assert
+    EXPECT_EQ(error_value, 0);
+    EXPECT_EQ(error_value_copy, 0);
+    EXPECT_EQ((void *)state.referencefloor().data().data(), (void *)floorBuffer);
+    EXPECT_EQ((void *)wrapped.data, (void *)floorBuffer);
+    EXPECT_NE((void *)solver.getState().referencefloor().data().data(), (void *)floorBuffer);
+    EXPECT_EQ(solver.getState().referencefloor().data(), state.referencefloor().data());
+    ASSERT_EQ(output.candidates_size(), 1);
+    EXPECT_EQ(MRA::convert_proto_to_json_str(solver.getOutput()), MRA::convert_proto_to_json_str(output));
+    ASSERT_GE(state.trackers_size(), 1);
+    ASSERT_EQ(solver.getState().trackers_size(), state.trackers_size());
+    EXPECT_EQ(MRA::convert_proto_to_json_str(solver.getState().trackers(0)), MRA::convert_proto_to_json_str(state.trackers(0)));
+}
+
+// Global search: without input guess, the robot should still be found (up to field symmetry)
+TEST(FalconsLocalizationVisionTest, globalSearchNoGuess)
+{
+    MRA_TRACE_TEST_FUNCTION();
+    // Arrange
+    auto m = FalconsLocalizationVision::FalconsLocalizationVision();
+    auto input = loadTestVectorInput("components/falcons/localization_vision/testdata/test2_shift_xy.json");
+    input.clear_guess();
+    auto output = FalconsLocalizationVision::Output();
+    auto params = m.defaultParams();
+    params.mutable_solver()->mutable_globalsearch()->set_enabled(true);
+
+    // Act
+    int error_value = m.tick(input, params, output);
+
+    // Assert
+    EXPECT_EQ(error_value, 0);
+    ASSERT_EQ(output.candidates_size(), 1);
+    expectPoseOrMirror(output.candidates(0).pose(), MRA::Geometry::Pose(-1.0, -2.0), 0.05, 0.02);
+}
+
+// Linepoint preprocessing: decimation per grid cell, closest points first, far points weigh less
+TEST(FalconsLocalizationVisionTest, linePointPreprocessor)
+{
+    MRA_TRACE_TEST_FUNCTION();
+    // Arrange
+    auto params = FalconsLocalizationVision::defaultParams();
+    auto preprocess = params.mutable_solver()->mutable_linepoints()->mutable_preprocess();
+    preprocess->set_gridsize(0.5);
+    preprocess->set_maxcount(2);
+    preprocess->set_distanceweighting(true);
+    std::vector<cv::Point2f> points = {{1.1, 0.1}, {1.3, 0.3}, {-2.1, 0.1}, {6.1, 0.1}};
+    std::vector<float> weights;
+
+    // Act
+    FalconsLocalizationVision::LinePointPreprocessor(params).run(points, weights);
+
+    // Assert
+    ASSERT_EQ(points.size(), 2);
+    ASSERT_EQ(weights.size(), 2);
+    std::sort(points.begin(), points.end(), [](cv::Point2f const &a, cv::Point2f const &b) { return a.x < b.x; });
+    EXPECT_NEAR(points[0].x, -2.1, 1e-5);
+    EXPECT_NEAR(points[1].x, 1.2, 1e-5); // centroid of first two points
+    EXPECT_NEAR(points[1].y, 0.2, 1e-5);
+    FalconsLocalizationVision::LinePointPreprocessor pp(params);
+    EXPECT_FLOAT_EQ(pp.weight(cv::Point2f(0.0, 0.0)), 1.0);
+    EXPECT_LT(pp.weight(cv::Point2f(6.0, 0.0)), pp.weight(cv::Point2f(2.0, 0.0)));
+    EXPECT_GE(pp.weight(cv::Point2f(30.0, 0.0)), 0.0);
+}
+
+// Linepoint preprocessing should not compromise the fit on a regular test vector
+TEST(FalconsLocalizationVisionTest, linePointPreprocessedFit)
+{
+    MRA_TRACE_TEST_FUNCTION();
+    // Arrange
+    auto m = FalconsLocalizationVision::FalconsLocalizationVision();
+    auto input = loadTestVectorInput("components/falcons/localization_vision/testdata/test2_shift_xy.json");
+    auto output = FalconsLocalizationVision::Output();
+    auto params = m.defaultParams();
+    auto preprocess = params.mutable_solver()->mutable_linepoints()->mutable_preprocess();
+    preprocess->set_gridsize(0.1);
+    preprocess->set_maxcount(20);
+    preprocess->set_distanceweighting(true);
+
+    // Act
+    int error_value = m.tick(input, params, output);
+
+    // Assert
+    EXPECT_EQ(error_value, 0);
+    ASSERT_EQ(output.candidates_size(), 1);
+    expectPoseOrMirror(output.candidates(0).pose(), MRA::Geometry::Pose(-1.0, -2.0), 0.05, 0.02);
+}
+
+// Optimizer benchmark: Levenberg-Marquardt should reach the same pose as the simplex solver, with an order of magnitude fewer evaluations
+TEST(FalconsLocalizationVisionTest, optimizerBenchmark)
+{
+    MRA_TRACE_TEST_FUNCTION();
+    // Arrange: all testdata vectors, with the pose of their expected output (the field model of a vector overrules the default)
+    std::vector<std::pair<std::string, MRA::Geometry::Pose>> testVectors = {
+        {"components/falcons/localization_vision/testdata/test1_perfect_fit.json", MRA::Geometry::Pose(0.0, 0.0)},
+        {"components/falcons/localization_vision/testdata/test2_shift_xy.json", MRA::Geometry::Pose(-1.0, -2.0)},
+        {"components/falcons/localization_vision/testdata/test3_grabs_r5_20191219_210335_bad_init.json", MRA::Geometry::Pose(0.674842954, 3.00080204, 0.0, 0.0, 0.0, 1.74070227)}
+    };
+    MRA::Geometry::Pose offset(0.08, -0.06, 0.0, 0.0, 0.0, 0.1); // within action radius
+
+    for (auto const &tv: testVectors)
+    {
+        auto params = FalconsLocalizationVision::defaultParams();
+        nlohmann::json j = nlohmann::json::parse(read_file_as_string(tv.first));
+        if (j.contains("Params"))
+        {
+            auto vectorParams = FalconsLocalizationVision::Params();
+            convert_json_to_proto(j, "Params", vectorParams);
+            params.mutable_model()->CopyFrom(vectorParams.model());
+        }
+        FalconsLocalizationVision::Solver solver;
+        solver.configure(params);
+        cv::Mat referenceFloor = solver.createReferenceFloorMat(params.solver().blurfactor());
+        cv::Mat distanceField = FalconsLocalizationVision::DistanceFitFunction::createDistanceField(referenceFloor, params.solver().pixelspermeter(), params.solver().levenbergmarquardt().distanceclip());
+        MRA::Geometry::Pose step(params.solver().actionradius());
+        std::map<int, FalconsLocalizationVision::FitResult> results;
+        auto input = loadTestVectorInput(tv.first);
+        std::vector<cv::Point2f> points;
+        for (auto const &landmark: input.landmarks())
+        {
+            points.push_back(cv::Point2f(landmark.x(), landmark.y()));
+        }
+        MRA::Geometry::Pose guess(tv.second.x + offset.x, tv.second.y + offset.y, 0.0, 0.0, 0.0, tv.second.rz + offset.rz);
+        for (auto optimizer: {FalconsLocalizationVision::OptimizerEnum::DOWNHILL_SIMPLEX, FalconsLocalizationVision::OptimizerEnum::LEVENBERG_MARQUARDT})
+        {
+            FalconsLocalizationVision::FitCore fitCore;
+            params.mutable_solver()->set_optimizer(optimizer);
+            fitCore.configure(params.solver());
+            fitCore.distanceField = distanceField;
+
+            // Act
+            auto fr = fitCore.run(referenceFloor, points, std::vector<float>(), guess, step);
+
+            // Assert
+            EXPECT_NEAR(fr.pose.x, tv.second.x, 0.03) << tv.first;
+            EXPECT_NEAR(fr.pose.y, tv.second.y, 0.03) << tv.first;
+            EXPECT_NEAR(MRA::Geometry::wrap_pi(fr.pose.rz - tv.second.rz), 0.0, 0.02) << tv.first;
+            results[optimizer] = fr;
+        }
+        auto const &simplex = results[FalconsLocalizationVision::OptimizerEnum::DOWNHILL_SIMPLEX];
+        auto const &lm = results[FalconsLocalizationVision::OptimizerEnum::LEVENBERG_MARQUARDT];
+        EXPECT_GT(lm.evaluations, 0);
+        EXPECT_LE(10 * lm.evaluations, simplex.evaluations) << tv.first;
+        // scored with the same FitFunction (0.0 is perfect), so LM should not be (much) worse than the simplex
+        EXPECT_LT(lm.score, simplex.score + 0.02) << tv.first;
+    }
+}
+
+// Levenberg-Marquardt distance field is cached in state, next to the reference floor, and only recreated when params change
+TEST(FalconsLocalizationVisionTest, distanceFieldCache)
+{
+    MRA_TRACE_TEST_FUNCTION();
+    // Arrange
+    auto m = FalconsLocalizationVision::FalconsLocalizationVision();
+    auto input = loadTestVectorInput("components/falcons/localization_vision/testdata/test2_shift_xy.json");
+    auto params = m.defaultParams();
+    params.mutable_solver()->set_optimizer(FalconsLocalizationVision::OptimizerEnum::LEVENBERG_MARQUARDT);
+    auto paramsClip = params;
+    paramsClip.mutable_solver()->mutable_levenbergmarquardt()->set_distanceclip(0.3);
+    auto state = FalconsLocalizationVision::State();
+    auto output = FalconsLocalizationVision::Output();
+    auto local1 = FalconsLocalizationVision::Local();
+    auto local2 = FalconsLocalizationVision::Local();
+    auto local3 = FalconsLocalizationVision::Local();
+
+    // Act
+    int error_value1 = m.tick(input, params, state, output, local1);
+    int error_value2 = m.tick(input, params, state, output, local2);
+    int error_value3 = m.tick(input, paramsClip, state, output, local3);
+
+    // Assert
+    EXPECT_EQ(error_value1, 0);
+    EXPECT_EQ(error_value2, 0);
+    EXPECT_EQ(error_value3, 0);
+    EXPECT_TRUE(state.has_distancefield());
+    EXPECT_EQ(state.distancefield().width(), state.referencefloor().width());
+    EXPECT_EQ(state.distancefield().height(), state.referencefloor().height());
+    EXPECT_TRUE(local1.timing().distancefieldcreated());
+    EXPECT_FALSE(local2.timing().distancefieldcreated());
+    EXPECT_TRUE(local3.timing().distancefieldcreated());
+    ASSERT_EQ(output.candidates_size(), 1);
+    expectPoseOrMirror(output.candidates(0).pose(), MRA::Geometry::Pose(-1.0, -2.0), 0.05, 0.02);
+}
+
+// Tracker lifecycle: good fits are persisted into state and warm-start the next tick, stale trackers expire
+TEST(FalconsLocalizationVisionTest, trackerPersistence)
+{
+    MRA_TRACE_TEST_FUNCTION();
+    // Arrange
+    auto m = FalconsLocalizationVision::FalconsLocalizationVision();
+    auto input = loadTestVectorInput("components/falcons/localization_vision/testdata/test2_shift_xy.json");
+    auto params = m.defaultParams();
+    auto state = FalconsLocalizationVision::State();
+    auto output1 = FalconsLocalizationVision::Output();
+    auto output2 = FalconsLocalizationVision::Output();
+    auto output3 = FalconsLocalizationVision::Output();
+    auto local = FalconsLocalizationVision::Local();
+    auto t1 = google::protobuf::util::TimeUtil::MillisecondsToTimestamp(1000);
+    auto t2 = google::protobuf::util::TimeUtil::MillisecondsToTimestamp(1100);
+    double timeout = params.solver().trackers().timeout();
+    auto t3 = google::protobuf::util::TimeUtil::MillisecondsToTimestamp(1100 + 2000 * timeout);
+
+    // Act & Assert: first tick, with input guess, should create a tracker
+    EXPECT_EQ(m.tick(t1, input, params, state, output1, local), 0);
+    ASSERT_GE(state.trackers_size(), 1);
+    EXPECT_LE(state.trackers_size(), params.solver().trackers().maxcount());
+    auto tracker = state.trackers(0);
+    expectPoseOrMirror(tracker.pose(), MRA::Geometry::Pose(-1.0, -2.0), 0.05, 0.02);
+    EXPECT_GT(tracker.id(), 0);
+    EXPECT_EQ(tracker.creation(), t1);
+
+    // Act & Assert: second tick, without input guess, should warm-start from the same tracker
+    input.clear_guess();
+    EXPECT_EQ(m.tick(t2, input, params, state, output2, local), 0);
+    ASSERT_EQ(output2.candidates_size(), 1);
+    expectPoseOrMirror(output2.candidates(0).pose(), MRA::Geometry::Pose(-1.0, -2.0), 0.05, 0.02);
+    ASSERT_GE(state.trackers_size(), 1);
+    EXPECT_EQ(state.trackers(0).id(), tracker.id());
+    EXPECT_EQ(state.trackers(0).creation(), t1);
+    EXPECT_EQ(state.trackers(0).lastactive(), t2);
+
+    // Act & Assert: when trackers are not refreshed (never confident enough) they expire after the timeout
+    params.mutable_solver()->mutable_trackers()->set_minconfidence(1.1);
+    EXPECT_EQ(m.tick(t3, input, params, state, output3, local), 0);
+    EXPECT_EQ(output3.candidates_size(), 1);
+    EXPECT_EQ(state.trackers_size(), 0);
+}
+
+// Tracker lifecycle does not depend on the clock: a tracker created at timestamp zero is not new anymore on the next tick
+TEST(FalconsLocalizationVisionTest, trackerCreatedAtEpoch)
+{
+    MRA_TRACE_TEST_FUNCTION();
+    // Arrange
+    auto m = FalconsLocalizationVision::FalconsLocalizationVision();
+    auto input = loadTestVectorInput("components/falcons/localization_vision/testdata/test2_shift_xy.json");
+    auto params = m.defaultParams();
+    auto state = FalconsLocalizationVision::State();
+    auto output = FalconsLocalizationVision::Output();
+    auto local = FalconsLocalizationVision::Local();
+    auto t1 = google::protobuf::util::TimeUtil::MillisecondsToTimestamp(0);
+    auto t2 = google::protobuf::util::TimeUtil::MillisecondsToTimestamp(100);
+    ASSERT_GT(params.solver().trackers().timeout(), 0.1);
+
+    // Act & Assert: first tick creates a tracker
+    EXPECT_EQ(m.tick(t1, input, params, state, output, local), 0);
+    ASSERT_GE(state.trackers_size(), 1);
+    auto tracker = state.trackers(0);
+    EXPECT_GT(tracker.id(), 0);
+    EXPECT_EQ(tracker.creation(), t1);
+
+    // Act & Assert: when not confident, an existing tracker is kept until the timeout (a new one would be dropped)
+    input.clear_guess();
+    params.mutable_solver()->mutable_trackers()->set_minconfidence(1.1);
+    EXPECT_EQ(m.tick(t2, input, params, state, output, local), 0);
+    ASSERT_GE(state.trackers_size(), 1);
+    EXPECT_EQ(state.trackers(0).id(), tracker.id());
+    EXPECT_EQ(state.trackers(0).creation(), t1);
+    EXPECT_EQ(state.trackers(0).lastactive(), t1);
+}
+
+// Analytic field model: distances to the letter model shapes, without rasterization
+TEST(FalconsLocalizationVisionTest, shapeField)
+{
+    MRA_TRACE_TEST_FUNCTION();
+    // Arrange
+    auto params = FalconsLocalizationVision::defaultParams();
+    FalconsLocalizationVision::Solver solver;
+    solver.configure(params);
+    auto config = params.solver().analytic();
+    double k = params.model().k();
+    double r = 0.5 * (params.model().h() - k); // center circle
+
+    // Act
+    FalconsLocalizationVision::ShapeField field(solver.createShapes(), config);
+
+    // Assert
+    EXPECT_GT(field.numPrimitives(), 0);
+    EXPECT_DOUBLE_EQ(field.distance(0.0, 0.0), 0.0); // center spot
+    EXPECT_DOUBLE_EQ(field.distance(3.0, 0.0), 0.0); // middle line
+    EXPECT_NEAR(field.distance(0.0, r + 0.5 * k + 0.05), 0.05, 1e-9); // just outside center circle
+    EXPECT_DOUBLE_EQ(field.score(3.0, 0.0), 1.0);
+    EXPECT_NEAR(field.score(0.0, r + 0.5 * k + 0.5 * config.falloff()), 0.5, 1e-9);
+    EXPECT_DOUBLE_EQ(field.score(3.0, 5.0), 0.0); // far from any line
+    EXPECT_DOUBLE_EQ(field.score(100.0, 0.0), 0.0); // outside of the index
+}
+
+// Analytic scoring should find the same pose as the raster scoring on a regular test vector
+TEST(FalconsLocalizationVisionTest, analyticScoringFit)
+{
+    MRA_TRACE_TEST_FUNCTION();
+    // Arrange
+    auto m = FalconsLocalizationVision::FalconsLocalizationVision();
+    auto input = loadTestVectorInput("components/falcons/localization_vision/testdata/test2_shift_xy.json");
+    auto output = FalconsLocalizationVision::Output();
+    auto params = m.defaultParams();
+    params.mutable_solver()->set_scoring(FalconsLocalizationVision::ScoringEnum::ANALYTIC);
+
+    // Act
+    int error_value = m.tick(input, params, output);
+
+    // Assert
+    EXPECT_EQ(error_value, 0);
+    ASSERT_EQ(output.candidates_size(), 1);
+    expectPoseOrMirror(output.candidates(0).pose(), MRA::Geometry::Pose(-1.0, -2.0), 0.05, 0.02);
+}
+
+// Analytic scoring does not need the reference floor, so it is neither created nor cached in state,
+// unless the diagnostics (or global search, or Levenberg-Marquardt) need it
+TEST(FalconsLocalizationVisionTest, analyticScoringNoReferenceFloor)
+{
+    MRA_TRACE_TEST_FUNCTION();
+    // Arrange
+    auto m = FalconsLocalizationVision::FalconsLocalizationVision();
+    auto input = loadTestVectorInput("components/falcons/localization_vision/testdata/test2_shift_xy.json");
+    auto params = m.defaultParams();
+    params.mutable_solver()->set_scoring(FalconsLocalizationVision::ScoringEnum::ANALYTIC);
+    auto paramsDebug = params;
+    paramsDebug.set_debug(true);
+    auto state = FalconsLocalizationVision::State();
+    auto stateDebug = FalconsLocalizationVision::State();
+    auto output = FalconsLocalizationVision::Output();
+    auto outputDebug = FalconsLocalizationVision::Output();
+    auto local = FalconsLocalizationVision::Local();
+    auto localDebug = FalconsLocalizationVision::Local();
+
+    // Act
+    int error_value = m.tick(input, params, state, output, local);
+    int error_value_debug = m.tick(input, paramsDebug, stateDebug, outputDebug, localDebug);
+
+    // Assert
+    EXPECT_EQ(error_value, 0);
+    EXPECT_EQ(error_value_debug, 0);
+    EXPECT_FALSE(state.has_referencefloor());
+    EXPECT_TRUE(stateDebug.has_referencefloor());
+    EXPECT_TRUE(localDebug.has_floor());
+    EXPECT_EQ(MRA::convert_proto_to_json_str(output), MRA::convert_proto_to_json_str(outputDebug));
+}
+
+// Field symmetry: search only the canonical half, output both the fit and its mirrored twin
+TEST(FalconsLocalizationVisionTest, symmetry)
+{
+    MRA_TRACE_TEST_FUNCTION();
+    // Arrange
+    auto m = FalconsLocalizationVision::FalconsLocalizationVision();
+    auto input = loadTestVectorInput("components/falcons/localization_vision/testdata/test2_shift_xy.json");
+    input.clear_guess();
+    auto output = FalconsLocalizationVision::Output();
+    auto params = m.defaultParams();
+    params.mutable_solver()->set_symmetry(true);
+    params.mutable_solver()->mutable_globalsearch()->set_enabled(true);
+    auto paramsGuessing = params;
+    configureGuessing(paramsGuessing);
+    std::vector<FalconsLocalizationVision::Tracker> trackers;
+
+    // Act
+    int error_value = m.tick(input, params, output);
+    FalconsLocalizationVision::Guesser(paramsGuessing, 0).run(trackers, true);
+
+    // Assert
+    EXPECT_EQ(error_value, 0);
+    ASSERT_EQ(output.candidates_size(), 2);
+    EXPECT_FALSE(output.candidates(0).mirrored());
+    EXPECT_TRUE(output.candidates(1).mirrored());
+    expectPoseOrMirror(output.candidates(0).pose(), MRA::Geometry::Pose(-1.0, -2.0), 0.05, 0.02);
+    EXPECT_DOUBLE_EQ(output.candidates(1).pose().x(), -output.candidates(0).pose().x());
+    EXPECT_DOUBLE_EQ(output.candidates(1).pose().y(), -output.candidates(0).pose().y());
+    EXPECT_DOUBLE_EQ(output.candidates(1).confidence(), output.candidates(0).confidence());
+    EXPECT_EQ((int)trackers.size(), paramsGuessing.solver().guessing().initial_size() / 2 + paramsGuessing.solver().guessing().random().count());
+    for (auto const &tr: trackers)
+    {
+        EXPECT_GE(tr.guess.y, 0.0);
+    }
+}
+
+// Packed landmarks should give the exact same result as regular landmarks
+TEST(FalconsLocalizationVisionTest, packedLandmarks)
+{
+    MRA_TRACE_TEST_FUNCTION();
+    // Arrange
+    auto m = FalconsLocalizationVision::FalconsLocalizationVision();
+    auto input = loadTestVectorInput("components/falcons/localization_vision/testdata/test2_shift_xy.json");
+    auto inputPacked = input;
+    inputPacked.clear_landmarks();
+    for (auto const &landmark: input.landmarks())
+    {
+        inputPacked.add_landmarkspacked(landmark.x());
+        inputPacked.add_landmarkspacked(landmark.y());
+    }
+    auto inputInvalid = inputPacked;
+    inputInvalid.add_landmarkspacked(1.0);
+    auto params = m.defaultParams();
+    auto output = FalconsLocalizationVision::Output();
+    auto outputPacked = FalconsLocalizationVision::Output();
+    auto outputInvalid = FalconsLocalizationVision::Output();
+
+    // Act
+    int error_value = m.tick(input, params, output);
+    int error_value_packed = m.tick(inputPacked, params, outputPacked);
+    int error_value_invalid = m.tick(inputInvalid, params, outputInvalid);
+
+    // Assert
+    EXPECT_EQ(error_value, 0);
+    EXPECT_EQ(error_value_packed, 0);
+    EXPECT_EQ(error_value_invalid, -1);
+    EXPECT_EQ(MRA::convert_proto_to_json_str(outputPacked), MRA::convert_proto_to_json_str(output));
+}
+
+// Bounded scoring: exact when below threshold, otherwise a lower bound above threshold; global search peaks unaffected
+TEST(FalconsLocalizationVisionTest, calcBounded)
+{
+    MRA_TRACE_TEST_FUNCTION();
+    // Arrange
+    auto params = FalconsLocalizationVision::defaultParams();
+    FalconsLocalizationVision::Solver solver;
+    solver.configure(params);
+    cv::Mat referenceFloor = solver.createReferenceFloorMat(params.solver().blurfactor());
+    auto input = loadTestVectorInput("components/falcons/localization_vision/testdata/test2_shift_xy.json");
+    std::vector<cv::Point2f> points;
+    for (auto const &landmark: input.landmarks())
+    {
+        points.push_back(cv::Point2f(landmark.x(), landmark.y()));
+    }
+    FalconsLocalizationVision::FitFunction fit(referenceFloor, points, params.solver().pixelspermeter());
+    auto paramsBounded = params;
+    paramsBounded.mutable_solver()->mutable_globalsearch()->set_bounded(true);
+
+    // Act & Assert
+    for (auto const &pose: {MRA::Geometry::Pose(-1.0, -2.0), MRA::Geometry::Pose(0.5, 1.0, 0.0, 0.0, 0.0, 0.3), MRA::Geometry::Pose(3.0, -4.0, 0.0, 0.0, 0.0, -2.0)})
+    {
+        double v[3] = {pose.x, pose.y, pose.rz};
+        double score = fit.calc(v);
+        EXPECT_NEAR(fit.calcBounded(v, 2.0), score, 1e-3);
+        EXPECT_NEAR(fit.calcBounded(v, score + 1e-3), score, 1e-3);
+        if (score > 0.1)
+        {
+            EXPECT_GT(fit.calcBounded(v, score - 0.1), score - 0.1);
+        }
+    }
+    auto peaks = FalconsLocalizationVision::GlobalSearch(params).run(referenceFloor, points, std::vector<float>());
+    auto peaksBounded = FalconsLocalizationVision::GlobalSearch(paramsBounded).run(referenceFloor, points, std::vector<float>());
+    ASSERT_EQ(peaks.size(), peaksBounded.size());
+    ASSERT_GT(peaks.size(), 0);
+    EXPECT_NEAR(peaks[0].pose.x, peaksBounded[0].pose.x, 1e-6);
+    EXPECT_NEAR(peaks[0].pose.y, peaksBounded[0].pose.y, 1e-6);
+    EXPECT_NEAR(peaks[0].pose.rz, peaksBounded[0].pose.rz, 1e-6);
+    EXPECT_NEAR(peaks[0].score, peaksBounded[0].score, 1e-3);
+}
+
+TEST(FalconsLocalizationVisionTest, tickTiming)
+{
+    MRA_TRACE_TEST_FUNCTION();
+    // Arrange
+    auto m = FalconsLocalizationVision::FalconsLocalizationVision();
+    auto input = loadTestVectorInput("components/falcons/localization_vision/testdata/test2_shift_xy.json");
+    auto params = m.defaultParams();
+    auto output = FalconsLocalizationVision::Output();
+    auto state = FalconsLocalizationVision::State();
+    auto local1 = FalconsLocalizationVision::Local();
+    auto local2 = FalconsLocalizationVision::Local();
+
+    // Act
+    int error_value1 = m.tick(input, params, state, output, local1);
+    int error_value2 = m.tick(input, params, state, output, local2);
+
+    // Assert: phases are timed, second tick hits the reference floor cache
+    EXPECT_EQ(error_value1, 0);
+    EXPECT_EQ(error_value2, 0);
+    for (auto const &timing: {local1.timing(), local2.timing()})
+    {
+        EXPECT_GT(timing.evaluations(), 0);
+        EXPECT_GT(timing.fit(), 0.0);
+        EXPECT_GT(timing.createtrackers(), 0.0);
+        EXPECT_GE(timing.statetransfer(), 0.0);
+    }
+    EXPECT_LT(local2.timing().reinitialize(), local1.timing().reinitialize());
+}
+
+TEST(FalconsLocalizationVisionTest, fixedPoint)
+{
+    MRA_TRACE_TEST_FUNCTION();
+    // Arrange
+    auto m = FalconsLocalizationVision::FalconsLocalizationVision();
+    auto params = m.defaultParams();
+    FalconsLocalizationVision::Solver solver;
+    solver.configure(params);
+    cv::Mat referenceFloor = solver.createReferenceFloorMat(params.solver().blurfactor());
+    auto input = loadTestVectorInput("components/falcons/localization_vision/testdata/test2_shift_xy.json");
+    std::vector<cv::Point2f> points;
+    for (auto const &landmark: input.landmarks())
+    {
+        points.push_back(cv::Point2f(landmark.x(), landmark.y()));
+    }
+    FalconsLocalizationVision::FitFunction fit(referenceFloor, points, params.solver().pixelspermeter());
+    FalconsLocalizationVision::FitFunction fitFixed(referenceFloor, points, params.solver().pixelspermeter());
+    fitFixed.setFixedPoint(true);
+    auto paramsFixed = params;
+    paramsFixed.mutable_solver()->set_fixedpoint(true);
+    auto output = FalconsLocalizationVision::Output();
+
+    // Act & Assert: scores only differ where a linepoint rounds to a neighboring pixel
+    for (auto const &pose: {MRA::Geometry::Pose(-1.0, -2.0), MRA::Geometry::Pose(0.5, 1.0, 0.0, 0.0, 0.0, 0.3), MRA::Geometry::Pose(3.0, -4.0, 0.0, 0.0, 0.0, -2.0)})
+    {
+        double v[3] = {pose.x, pose.y, pose.rz};
+        double score = fitFixed.calc(v);
+        EXPECT_NEAR(score, fit.calc(v), 0.01);
+        EXPECT_NEAR(fitFixed.calcBounded(v, 2.0), score, 1e-6);
+    }
+    int error_value = m.tick(input, paramsFixed, output);
+    EXPECT_EQ(error_value, 0);
+    ASSERT_EQ(output.candidates_size(), 1);
+    expectPoseOrMirror(output.candidates(0).pose(), MRA::Geometry::Pose(-1.0, -2.0), 0.05, 0.02);
+}
+
 int main(int argc, char **argv)
 {
     // Verify that the version of the library that we linked against is
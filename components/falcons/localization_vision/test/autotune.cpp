@@ -0,0 +1,254 @@
+// Headless offline tuning tool for LocalizationVision.
+// Evaluates every configuration of a parameter search space on a corpus of recorded ticks,
+// distributing configurations over threads, and reports accuracy versus runtime (Pareto front).
+//
+// Example:
+//     bazel run //components/falcons/localization_vision/test:autotune -- --space space.json tick_20230702_163900_008.bin ...
+//
+// Corpus files are either binary tick dumps or json test vectors, see corpus.hpp.
+//
+// The search space is a json object, mapping Params fields (dotted, as in DefaultParams.json) to a list of values:
+//     {"solver.blurFactor": [0.0, 0.86], "solver.maxCount": [100, 400]}
+// All combinations are evaluated.
+
+#include <iostream>
+#include <iomanip>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <algorithm>
+#include <google/protobuf/util/time_util.h>
+
+#include "corpus.hpp"
+#include "geometry.hpp"
+
+
+using namespace MRA::FalconsLocalizationVision;
+
+// default search space, covering the parameters which are typically tuned by hand
+const char *DEFAULT_SEARCH_SPACE = R"({
+    "solver.blurFactor": [0.0, 0.7, 0.86],
+    "solver.maxCount": [100, 200, 400],
+    "solver.epsilon": [1e-3, 1e-4],
+    "solver.pixelsPerMeter": [40, 60, 80],
+    "solver.linePoints.fit.radiusConstant": [0.03, 0.05, 0.08]
+})";
+
+
+struct Evaluation
+{
+    nlohmann::json config;
+    int numTicks = 0;
+    int numFailures = 0; // error code or no candidate
+    double meanErrorXY = 0.0; // [m] w.r.t. reference pose
+    double maxErrorXY = 0.0;
+    double meanErrorRz = 0.0; // [rad]
+    double meanScore = 0.0; // as Output candidate confidence
+    double meanDuration = 0.0; // [ms] per tick
+    double maxDuration = 0.0;
+    bool pareto = false;
+};
+
+
+std::vector<nlohmann::json> expandSearchSpace(nlohmann::json const &space)
+{
+    // cartesian product, each configuration is a nested json object to be merged into Params
+    std::vector<nlohmann::json> result(1, nlohmann::json::object());
+    for (auto const &[key, values]: space.items())
+    {
+        if (!values.is_array() || values.empty())
+        {
+            throw std::runtime_error("search space entry " + key + " should be a non-empty list of values");
+        }
+        std::vector<nlohmann::json> expanded;
+        for (auto const &config: result)
+        {
+            for (auto const &value: values)
+            {
+                nlohmann::json c = config;
+                std::string pointer = "/" + key;
+                std::replace(pointer.begin(), pointer.end(), '.', '/');
+                c[nlohmann::json::json_pointer(pointer)] = value;
+                expanded.push_back(c);
+            }
+        }
+        result = expanded;
+    }
+    return result;
+}
+
+Evaluation evaluate(nlohmann::json const &config, std::vector<RecordedTick> const &corpus)
+{
+    Evaluation result;
+    result.config = config;
+    StateType cache; // reference floor, only recalculated when params change between ticks
+    for (auto const &tick: corpus)
+    {
+        ParamsType params = tick.params;
+        MRA::merge_json_into_proto(config, params);
+        StateType state = tick.state;
+        if (cache.params().SerializeAsString() != params.SerializeAsString())
+        {
+            // untimed warm-up tick, to not measure the (one-time) reference floor creation
+            OutputType output;
+            LocalType local;
+            StateType warmup = state;
+            FalconsLocalizationVision().tick(google::protobuf::util::TimeUtil::GetCurrentTime(), tick.input, params, warmup, output, local);
+            cache.mutable_params()->CopyFrom(warmup.params());
+            cache.mutable_referencefloor()->CopyFrom(warmup.referencefloor());
+        }
+        state.mutable_params()->CopyFrom(cache.params());
+        state.mutable_referencefloor()->CopyFrom(cache.referencefloor());
+
+        OutputType output;
+        LocalType local;
+        auto t0 = std::chrono::steady_clock::now();
+        int error_value = FalconsLocalizationVision().tick(google::protobuf::util::TimeUtil::GetCurrentTime(), tick.input, params, state, output, local);
+        double duration = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+
+        result.numTicks++;
+        result.meanDuration += duration;
+        result.maxDuration = std::max(result.maxDuration, duration);
+        if (error_value != 0 || output.candidates_size() == 0)
+        {
+            result.numFailures++;
+            continue;
+        }
+        auto const &pose = output.candidates(0).pose();
+        result.meanScore += output.candidates(0).confidence();
+        if (tick.hasReference)
+        {
+            double errorXY = hypot(pose.x() - tick.reference.x(), pose.y() - tick.reference.y());
+            result.meanErrorXY += errorXY;
+            result.maxErrorXY = std::max(result.maxErrorXY, errorXY);
+            result.meanErrorRz += fabs(MRA::Geometry::wrap_pi(pose.rz() - tick.reference.rz()));
+        }
+    }
+    int numSucceeded = result.numTicks - result.numFailures;
+    result.meanDuration /= std::max(1, result.numTicks);
+    result.meanScore /= std::max(1, numSucceeded);
+    result.meanErrorXY /= std::max(1, numSucceeded);
+    result.meanErrorRz /= std::max(1, numSucceeded);
+    return result;
+}
+
+void markParetoFront(std::vector<Evaluation> &evaluations)
+{
+    // minimize both runtime and error, failures count as infinitely bad accuracy
+    // after sorting on runtime, a configuration is on the front when it is more accurate than all faster ones
+    std::sort(evaluations.begin(), evaluations.end(), [](Evaluation const &a, Evaluation const &b) { return a.meanDuration < b.meanDuration; });
+    double bestError = std::numeric_limits<double>::infinity();
+    for (auto &e: evaluations)
+    {
+        double error = e.numFailures ? std::numeric_limits<double>::infinity() : e.meanErrorXY;
+        e.pareto = (error < bestError);
+        bestError = std::min(bestError, error);
+    }
+}
+
+void report(std::vector<Evaluation> const &evaluations, std::ostream &os)
+{
+    os << "  pareto  duration[ms]   max[ms]  errorXY[m]  maxXY[m]  errorRz[rad]    score  failures  config" << std::endl;
+    for (auto const &e: evaluations)
+    {
+        os << std::setw(8) << (e.pareto ? "*" : "")
+           << std::fixed << std::setprecision(2) << std::setw(14) << e.meanDuration << std::setw(10) << e.maxDuration
+           << std::setprecision(4) << std::setw(12) << e.meanErrorXY << std::setw(10) << e.maxErrorXY << std::setw(14) << e.meanErrorRz
+           << std::setw(9) << e.meanScore << std::setw(10) << e.numFailures << "  " << e.config.dump() << std::endl;
+    }
+}
+
+nlohmann::json toJson(std::vector<Evaluation> const &evaluations)
+{
+    nlohmann::json result = nlohmann::json::array();
+    for (auto const &e: evaluations)
+    {
+        result.push_back({{"config", e.config}, {"pareto", e.pareto}, {"numTicks", e.numTicks}, {"numFailures", e.numFailures},
+            {"meanDuration", e.meanDuration}, {"maxDuration", e.maxDuration}, {"meanErrorXY", e.meanErrorXY},
+            {"maxErrorXY", e.maxErrorXY}, {"meanErrorRz", e.meanErrorRz}, {"meanScore", e.meanScore}});
+    }
+    return result;
+}
+
+void usage()
+{
+    std::cerr << "usage: autotune [--space <json file>] [--threads <n>] [--output <json file>] <tick file or test vector> ..." << std::endl;
+}
+
+int main(int argc, char **argv)
+{
+    std::string spaceFile;
+    std::string outputFile;
+    int numThreads = std::max(1u, std::thread::hardware_concurrency());
+    std::vector<std::string> corpusFiles;
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string arg = argv[i];
+        if ((arg == "--space" || arg == "--threads" || arg == "--output") && i + 1 < argc)
+        {
+            std::string value = argv[++i];
+            if (arg == "--space") spaceFile = value;
+            else if (arg == "--threads") numThreads = std::max(1, std::stoi(value));
+            else outputFile = value;
+        }
+        else if (arg == "-h" || arg == "--help" || arg.rfind("--", 0) == 0)
+        {
+            usage();
+            return 1;
+        }
+        else
+        {
+            corpusFiles.push_back(arg);
+        }
+    }
+    if (corpusFiles.empty())
+    {
+        usage();
+        return 1;
+    }
+
+    try
+    {
+        std::vector<RecordedTick> corpus;
+        for (auto const &filename: corpusFiles)
+        {
+            corpus.push_back(loadTick(filename));
+        }
+        nlohmann::json space = nlohmann::json::parse(spaceFile.size() ? MRA::read_file_as_string(spaceFile) : std::string(DEFAULT_SEARCH_SPACE));
+        std::vector<nlohmann::json> configs = expandSearchSpace(space);
+        std::cerr << "evaluating " << configs.size() << " configurations on " << corpus.size() << " ticks, using " << numThreads << " threads" << std::endl;
+
+        // each thread picks the next configuration, so the load stays balanced
+        // note: concurrent threads compete for memory bandwidth, use --threads 1 for the most representative timing
+        std::vector<Evaluation> evaluations(configs.size());
+        std::atomic<size_t> next(0);
+        std::vector<std::thread> threads;
+        for (int it = 0; it < numThreads; ++it)
+        {
+            threads.emplace_back([&]()
+            {
+                for (size_t ic = next++; ic < configs.size(); ic = next++)
+                {
+                    evaluations[ic] = evaluate(configs[ic], corpus);
+                }
+            });
+        }
+        for (auto &t: threads)
+        {
+            t.join();
+        }
+
+        markParetoFront(evaluations);
+        report(evaluations, std::cout);
+        if (outputFile.size())
+        {
+            std::ofstream(outputFile) << toJson(evaluations).dump(4) << std::endl;
+        }
+    }
+    catch (const std::exception &e)
+    {
+        std::cerr << "ERROR: " << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
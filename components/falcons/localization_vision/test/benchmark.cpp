@@ -0,0 +1,200 @@
+// Benchmark for LocalizationVision on a recorded sequence of ticks.
+// Runs the ticks in order (optionally looping), carrying state from one tick to the next as on the robot,
+// and reports the latency per tick and per phase (see Local.proto Timing), plus the cost per scoring evaluation.
+//
+// Example:
+//     bazel run //components/falcons/localization_vision/test:benchmark -- --repeat 10 /tmp/testsuite_mra_logging/tickbins/tick_FalconsLocalizationVision_*.bin
+//
+// Corpus files are either binary tick dumps or json test vectors, see corpus.hpp.
+// The first tick(s) are run untimed as warm-up, since they include the (one-time) reference floor creation.
+
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <cmath>
+#include <algorithm>
+#include <google/protobuf/util/time_util.h>
+
+#include "corpus.hpp"
+
+
+using namespace MRA::FalconsLocalizationVision;
+
+struct Samples
+{
+    std::string name;
+    std::vector<double> values; // [ms]
+
+    double mean() const
+    {
+        double sum = 0.0;
+        for (double v: values) sum += v;
+        return sum / std::max<size_t>(1, values.size());
+    }
+
+    // nearest-rank percentile, p in [0, 100]
+    double percentile(double p) const
+    {
+        if (values.empty()) return 0.0;
+        std::vector<double> sorted = values;
+        std::sort(sorted.begin(), sorted.end());
+        size_t rank = (size_t)std::ceil(0.01 * p * sorted.size());
+        return sorted[std::clamp<size_t>(rank, 1, sorted.size()) - 1];
+    }
+};
+
+struct Report
+{
+    int numTicks = 0;
+    int numFailures = 0; // error code or no candidate
+    long evaluations = 0; // summed over all ticks
+    double fitSeconds = 0.0; // summed over all ticks
+    std::vector<Samples> phases = {{"tick"}, {"reinitialize"}, {"createLinePoints"}, {"createTrackers"}, {"fit"}, {"diagnostics"}, {"stateTransfer"}};
+
+    void add(double tick, Timing const &timing)
+    {
+        std::vector<double> values = {tick, timing.reinitialize(), timing.createlinepoints(), timing.createtrackers(), timing.fit(), timing.diagnostics(), timing.statetransfer()};
+        phases[0].values.push_back(values[0]);
+        for (size_t i = 1; i < phases.size(); ++i)
+        {
+            phases[i].values.push_back(1e3 * values[i]);
+        }
+        evaluations += timing.evaluations();
+        fitSeconds += timing.fit();
+        numTicks++;
+    }
+
+    // note: with solver.numExtraThreads, the fit phase is wall time over multiple threads, so the cost per evaluation is underestimated
+    double nsPerEvaluation() const { return evaluations ? 1e9 * fitSeconds / evaluations : 0.0; }
+    double evaluationsPerTick() const { return (double)evaluations / std::max(1, numTicks); }
+};
+
+Report run(std::vector<RecordedTick> const &corpus, int repeat, int warmup, double dt, bool recordedState)
+{
+    Report result;
+    auto timestamp = google::protobuf::util::TimeUtil::GetCurrentTime();
+    auto step = google::protobuf::util::TimeUtil::NanosecondsToDuration((int64_t)(1e9 * dt));
+    StateType state = corpus.front().state;
+    int count = 0;
+    for (int r = 0; r < repeat; ++r)
+    {
+        for (auto const &tick: corpus)
+        {
+            if (recordedState)
+            {
+                // restart from the recorded trackers, but keep the cached reference floor
+                StateType recorded = tick.state;
+                recorded.mutable_params()->Swap(state.mutable_params());
+                recorded.mutable_referencefloor()->Swap(state.mutable_referencefloor());
+                state = std::move(recorded);
+            }
+            OutputType output;
+            LocalType local;
+            timestamp += step;
+            auto t0 = std::chrono::steady_clock::now();
+            int error_value = FalconsLocalizationVision().tick(timestamp, tick.input, tick.params, state, output, local);
+            double duration = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+            if (count++ < warmup)
+            {
+                continue;
+            }
+            result.add(duration, local.timing());
+            if (error_value != 0 || output.candidates_size() == 0)
+            {
+                result.numFailures++;
+            }
+        }
+    }
+    return result;
+}
+
+void report(Report const &r, std::ostream &os)
+{
+    os << "ticks: " << r.numTicks << ", failures: " << r.numFailures << std::endl;
+    os << std::fixed << std::setprecision(1) << "evaluations per tick: " << r.evaluationsPerTick()
+       << ", ns per evaluation: " << r.nsPerEvaluation() << std::endl;
+    os << "           phase  mean[ms]   p50[ms]   p99[ms]   max[ms]" << std::endl;
+    for (auto const &p: r.phases)
+    {
+        os << std::setw(16) << p.name << std::setprecision(3)
+           << std::setw(10) << p.mean() << std::setw(10) << p.percentile(50) << std::setw(10) << p.percentile(99) << std::setw(10) << p.percentile(100) << std::endl;
+    }
+}
+
+nlohmann::json toJson(Report const &r)
+{
+    nlohmann::json result = {{"numTicks", r.numTicks}, {"numFailures", r.numFailures},
+        {"evaluationsPerTick", r.evaluationsPerTick()}, {"nsPerEvaluation", r.nsPerEvaluation()}};
+    for (auto const &p: r.phases)
+    {
+        result["phases"][p.name] = {{"mean", p.mean()}, {"p50", p.percentile(50)}, {"p99", p.percentile(99)}, {"max", p.percentile(100)}};
+    }
+    return result;
+}
+
+void usage()
+{
+    std::cerr << "usage: benchmark [--repeat <n>] [--warmup <n>] [--dt <seconds>] [--recorded-state] [--output <json file>] <tick file or test vector> ..." << std::endl;
+}
+
+int main(int argc, char **argv)
+{
+    int repeat = 1;
+    int warmup = 1;
+    double dt = 0.025; // typical vision rate of 40Hz, relevant for tracker timeout
+    bool recordedState = false;
+    std::string outputFile;
+    std::vector<std::string> corpusFiles;
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string arg = argv[i];
+        if ((arg == "--repeat" || arg == "--warmup" || arg == "--dt" || arg == "--output") && i + 1 < argc)
+        {
+            std::string value = argv[++i];
+            if (arg == "--repeat") repeat = std::max(1, std::stoi(value));
+            else if (arg == "--warmup") warmup = std::max(0, std::stoi(value));
+            else if (arg == "--dt") dt = std::stod(value);
+            else outputFile = value;
+        }
+        else if (arg == "--recorded-state")
+        {
+            recordedState = true;
+        }
+        else if (arg == "-h" || arg == "--help" || arg.rfind("--", 0) == 0)
+        {
+            usage();
+            return 1;
+        }
+        else
+        {
+            corpusFiles.push_back(arg);
+        }
+    }
+    if (corpusFiles.empty())
+    {
+        usage();
+        return 1;
+    }
+
+    try
+    {
+        std::vector<RecordedTick> corpus;
+        for (auto const &filename: corpusFiles)
+        {
+            corpus.push_back(loadTick(filename));
+        }
+        std::cerr << "running " << corpus.size() << " ticks " << repeat << " time(s), " << warmup << " warm-up tick(s)" << std::endl;
+        Report r = run(corpus, repeat, warmup, dt, recordedState);
+        report(r, std::cout);
+        if (outputFile.size())
+        {
+            std::ofstream(outputFile) << toJson(r).dump(4) << std::endl;
+        }
+    }
+    catch (const std::exception &e)
+    {
+        std::cerr << "ERROR: " << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
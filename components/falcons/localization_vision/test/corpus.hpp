@@ -0,0 +1,85 @@
+// Loading recorded ticks for the offline tools (autotune, benchmark).
+// Corpus files are either binary tick dumps (see MRA libraries/logging/logging.hpp dumpToFile)
+// or json test vectors (see testdata). The recorded output is used as reference pose.
+
+#ifndef _MRA_FALCONS_LOCALIZATION_VISION_TEST_CORPUS_HPP
+#define _MRA_FALCONS_LOCALIZATION_VISION_TEST_CORPUS_HPP
+
+#include <fstream>
+#include <algorithm>
+
+#include "FalconsLocalizationVision.hpp"
+#include "json_convert.hpp"
+
+
+namespace MRA::FalconsLocalizationVision
+{
+
+struct RecordedTick
+{
+    std::string filename;
+    InputType input;
+    ParamsType params;
+    StateType state;
+    bool hasReference = false;
+    MRA::Datatypes::Pose reference;
+};
+
+inline std::string readMessage(std::ifstream &f, std::string const &filename)
+{
+    // each protobuf object is an int (#bytes) followed by serialized protobuf bytes
+    int32_t n = 0;
+    f.read(reinterpret_cast<char *>(&n), sizeof(n));
+    std::string result(std::max(0, n), '\0');
+    f.read(result.data(), result.size());
+    if (!f)
+    {
+        throw std::runtime_error("failed to read tick file " + filename);
+    }
+    return result;
+}
+
+inline RecordedTick loadTick(std::string const &filename)
+{
+    // same convention as test/common.py: defaultParams, overruled by recorded values
+    RecordedTick result;
+    result.filename = filename;
+    result.params = FalconsLocalizationVision().defaultParams();
+    OutputType output;
+    if (filename.size() > 5 && filename.substr(filename.size() - 5) == ".json")
+    {
+        nlohmann::json j = nlohmann::json::parse(MRA::read_file_as_string(filename));
+        MRA::convert_json_to_proto(j, "Input", result.input);
+        if (j.contains("Params"))
+        {
+            ParamsType recorded;
+            MRA::convert_json_to_proto(j, "Params", recorded);
+            result.params.MergeFrom(recorded);
+        }
+        MRA::convert_json_to_proto(j, "State", result.state);
+        MRA::convert_json_to_proto(j, "Output", output);
+    }
+    else
+    {
+        std::ifstream f(filename, std::ios::binary);
+        result.input.ParseFromString(readMessage(f, filename));
+        ParamsType recorded;
+        recorded.ParseFromString(readMessage(f, filename));
+        result.params.MergeFrom(recorded);
+        result.state.ParseFromString(readMessage(f, filename));
+        output.ParseFromString(readMessage(f, filename));
+    }
+    // the reference floor is recalculated by the tools anyway
+    result.state.clear_referencefloor();
+    result.state.clear_params();
+    if (output.candidates_size())
+    {
+        result.hasReference = true;
+        result.reference = output.candidates(0).pose();
+    }
+    return result;
+}
+
+} // namespace MRA::FalconsLocalizationVision
+
+#endif
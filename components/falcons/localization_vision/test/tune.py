@@ -77,6 +77,8 @@ class TuningTool():
     def __init__(self, filename):
         self.image = None
         self.data = common.Data(filename)
+        # the tool shows local.floor, which is only rendered when debug is set (not a tunable param)
+        self.data.params.debug = True
         self.params = parameters.ParametersProxy(self.data.params.solver, RANGE_HINTS)
         self.gui = gui.WindowManager(self.params, callback=self.get_image)
         self._stop = False
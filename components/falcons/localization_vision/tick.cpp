@@ -9,6 +9,7 @@ using namespace MRA;
 // custom includes, if any
 #include "solver.hpp"
 #include "logging.hpp" // TODO: automate, perhaps via generated hpp
+#include <chrono>
 
 
 
@@ -33,16 +34,32 @@ int FalconsLocalizationVision::FalconsLocalizationVision::tick
         // TODO: how expensive is it to reconstruct everything each tick? we could use static data to improve performance at the cost of state observability/testability
         Solver solver;
         solver.configure(params);
-        solver.setState(state);
 
         // run
+        // state is moved in and out instead of copied, since it contains the reference floor
+        // (on exception, it is handed back with at most a refreshed reference floor cache)
+        solver.setTimestamp(timestamp);
         solver.setInput(input);
-        error_value = solver.run();
+        auto t0 = std::chrono::steady_clock::now();
+        solver.setState(std::move(state));
+        auto t1 = std::chrono::steady_clock::now();
+        try
+        {
+            error_value = solver.run();
+        }
+        catch (...)
+        {
+            state = solver.releaseState();
+            throw;
+        }
 
         // store output
         output.CopyFrom(solver.getOutput());
         local.CopyFrom(solver.getDiagnostics());
-        state.CopyFrom(solver.getState());
+        auto t2 = std::chrono::steady_clock::now();
+        state = solver.releaseState();
+        auto t3 = std::chrono::steady_clock::now();
+        local.mutable_timing()->set_statetransfer(std::chrono::duration<double>((t1 - t0) + (t3 - t2)).count());
     }
     catch (const std::exception& e)
     {
@@ -16,6 +16,13 @@
 
 // external
 #include <ReflexxesAPI.h>
+#include <RMLPositionFlags.h>
+#include <RMLPositionInputParameters.h>
+#include <RMLPositionOutputParameters.h>
+#include <RMLVelocityFlags.h>
+#include <RMLVelocityInputParameters.h>
+#include <RMLVelocityOutputParameters.h>
+#include <memory>
 
 
 struct SpgLimits
@@ -26,8 +33,39 @@ struct SpgLimits
     float ax;
     float ay;
     float aRz;
+
+    bool operator==(SpgLimits const &other) const
+    {
+        return vx == other.vx && vy == other.vy && vRz == other.vRz && ax == other.ax && ay == other.ay && aRz == other.aRz;
+    }
+    bool operator!=(SpgLimits const &other) const { return !(*this == other); }
+};
+
+// preallocated Reflexxes objects for one DOF configuration, reused for every call
+// (construction is expensive: each ReflexxesAPI heap-allocates dozens of vectors)
+template <typename InputType, typename OutputType, typename FlagsType>
+struct SpgObjects
+{
+    SpgObjects(int numberOfDOFs, double cycleTime) : RML(numberOfDOFs, cycleTime), IP(numberOfDOFs), OP(numberOfDOFs) {}
+
+    // Reflexxes continues a previously calculated trajectory when the inputs match it,
+    // which would make results depend on the previous call; flags different from the previous call force a new calculation,
+    // so toggle the extremum motion states calculation, of which the result is not used
+    FlagsType const &nextFlags()
+    {
+        Flags.EnableTheCalculationOfTheExtremumMotionStates = !Flags.EnableTheCalculationOfTheExtremumMotionStates;
+        return Flags;
+    }
+
+    ReflexxesAPI RML;
+    InputType IP;
+    OutputType OP;
+    FlagsType Flags;
 };
 
+typedef SpgObjects<RMLPositionInputParameters, RMLPositionOutputParameters, RMLPositionFlags> SpgPositionObjects;
+typedef SpgObjects<RMLVelocityInputParameters, RMLVelocityOutputParameters, RMLVelocityFlags> SpgVelocityObjects;
+
 class SPGVelocitySetpointController : public AbstractVelocitySetpointController
 {
 public:
@@ -35,14 +73,32 @@ public:
     ~SPGVelocitySetpointController();
     bool calculate(VelocityControlData &data);
 
+    // evaluate the trajectory of the last Reflexxes calculation at given time (relative to the calculation, in RCS at the time of the calculation)
+    // public for testing purposes, see describeTrajectory
+    void sampleLastSolve(double t, Velocity2D &velocity, Velocity2D &acceleration);
+
+    // solve collinear XY together with Rz in a single Reflexxes call, see calculateSPG
+    // public for testing purposes: disable to compare against the separate XY and Rz solves
+    bool fuseCollinearXY = true;
+
 private:
     bool calculateSPG(VelocityControlData& data, SpgLimits const &spgLimits, Position2D& resultPosition, Velocity2D &resultVelocity);
-    bool isDofAccelerating(const VelocityControlData &data, const Velocity2D& resultVelocity, int dof, float threshold);
+    void prepareObjects(double dt);
+    SpgLimits selectLimits(const VelocityControlData &data, SpgLimits const &decelerationLimits, const Velocity2D& resultVelocity);
+    bool isDofAccelerating(double currentVelocity, double newVelocity, float threshold);
+    Velocity2D predictVelocity(const VelocityControlData &data, SpgLimits const &spgLimits);
+    bool reduceCollinearXY(SpgLimits const &spgLimits, MRA::Geometry::Point &direction, double &maxVelocity, double &maxAcceleration);
+    void countSolve(VelocityControlData &data, int resultValue);
+
+    // trajectory description
+    void describeTrajectory(VelocityControlData &data);
+    bool describeSegments(VelocityTrajectory &trajectory, double ta, Velocity2D const &va, double tb, Velocity2D const &vb, int depth);
 
     // Position SPG
-    bool calculatePosXYRzPhaseSynchronized(VelocityControlData& data, SpgLimits const &spgLimits, Position2D& resultPosition, Velocity2D &resultVelocity);
+    bool calculatePosXYRz(VelocityControlData& data, SpgPositionObjects &objects, SpgLimits const &spgLimits, Position2D& resultPosition, Velocity2D &resultVelocity);
     bool calculatePosXYPhaseSynchronized(VelocityControlData& data, SpgLimits const &spgLimits, Position2D& resultPosition, Velocity2D &resultVelocity);
     bool calculatePosRzNonSynchronized(VelocityControlData& data, SpgLimits const &spgLimits, Position2D& resultPosition, Velocity2D &resultVelocity);
+    bool calculatePosXYCollinearRzNonSynchronized(VelocityControlData& data, SpgLimits const &spgLimits, MRA::Geometry::Point const &direction, double maxVelocity, double maxAcceleration, Position2D& resultPosition, Velocity2D &resultVelocity);
 
     // Velocity SPG
     bool calculateVelXYRzPhaseSynchronized(VelocityControlData& data, SpgLimits const &spgLimits, Position2D& resultPosition, Velocity2D &resultVelocity);
@@ -52,6 +108,19 @@ private:
     Velocity2D _currentVelocityRCS;
     Velocity2D _targetVelocityRCS;
 
+    // Reflexxes objects per DOF configuration, (re)created when dt changes
+    double _dt = 0.0;
+    std::unique_ptr<SpgPositionObjects> _posXYRz;
+    std::unique_ptr<SpgPositionObjects> _posSRz; // XY reduced to one DOF along _directionXY, and Rz
+    std::unique_ptr<SpgPositionObjects> _posXY;
+    std::unique_ptr<SpgPositionObjects> _posRz;
+    std::unique_ptr<SpgVelocityObjects> _velXYRz;
+
+    // which objects hold the trajectory of the last calculation
+    enum class LastSolve { NONE, POS_XYRZ, POS_XY_AND_RZ, POS_SRZ, VEL_XYRZ };
+    LastSolve _lastSolve = LastSolve::NONE;
+    MRA::Geometry::Point _directionXY; // unit vector of the reduced XY DOF
+
 };
 
 #endif
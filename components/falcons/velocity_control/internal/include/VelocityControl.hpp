@@ -16,12 +16,62 @@
 namespace MRA::internal::FVC
 {
 
+// the sequence of algorithms matters and is managed here
+typedef AlgorithmChain<
+    // check that input contains valid data (no z,rx,ry)
+    // determine control mode: POSVEL, POS_ONLY or VEL_ONLY
+    // set internal variables based on inputs, state, params
+    AlgorithmStep<CheckPrepareInputs>,
+    // determine the limits to use based on configuration and input motion profile
+    AlgorithmStep<ConfigureLimits>,
+    // immediately stop when the command is given (hard motor brake instead of SPG rampdown)
+    AlgorithmStep<CheckStop>,
+    // prevent runaway setpoints by ensuring that last call was recent enough
+    //AlgorithmStep<Watchdog>,
+    // prevent wasting energy by responding to very small setpoints
+    AlgorithmStep<Deadzone>,
+    // to enable dribbling, limits should apply to ball, not robot
+    AlgorithmStep<ShiftBallOffset>,
+    // velocity control (in FCS or RCS, depends on configuration)
+    // for now: always SPG (SetPointGenerator) using Reflexxes Type II library
+    AlgorithmStep<SelectVelocityController>,
+    AlgorithmStep<CalculateVelocity>,
+    // SPG intrinsically ensures limits are satisfied
+    // if the controller would be PID or Linear, then ApplyLimits would be needed
+    //AlgorithmStep<ApplyLimits>,
+    // to enable dribbling, limits should apply to ball, not robot
+    AlgorithmStep<UnShiftBallOffset>,
+    // finally, set output data, write state variables to be used in next iteration
+    AlgorithmStep<SetOutputsPrepareNext, true>
+> DefaultAlgorithmChain;
+
+// lightweight chain for a velocity-only setpoint: Deadzone only applies to position setpoints
+// (the ball offset shift remains, since unshifting also converts the resulting velocity)
+typedef AlgorithmChain<
+    AlgorithmStep<CheckPrepareInputs>,
+    AlgorithmStep<ConfigureLimits>,
+    AlgorithmStep<CheckStop>,
+    AlgorithmStep<ShiftBallOffset>,
+    AlgorithmStep<SelectVelocityController>,
+    AlgorithmStep<CalculateVelocity>,
+    AlgorithmStep<UnShiftBallOffset>,
+    AlgorithmStep<SetOutputsPrepareNext, true>
+> VelOnlyAlgorithmChain;
+
 class VelocityControl
 {
 public:
     VelocityControl();
     ~VelocityControl();
 
+    // (re)configure, only when params differ from the current configuration
+    // the controller is kept for subsequent ticks, so the instance should be long-lived
+    // return true if the pipeline was reconfigured
+    bool configure(MRA_ParamsType const &params);
+
+    // whether the pipeline is configured with given params, serialized as in configure
+    bool isConfiguredWith(std::string const &serializedParams) const;
+
     void iterate();
 
 public:
@@ -29,9 +79,12 @@ public:
     VelocityControlData data{};
 
 private:
-    std::vector<std::shared_ptr<VelocityControlAlgorithm>> algorithms;
-    void setup();
-    void add_algorithm(std::shared_ptr<VelocityControlAlgorithm> alg, bool unskippable = false);
+    DefaultAlgorithmChain defaultChain;
+    VelOnlyAlgorithmChain velOnlyChain;
+    std::string serializedConfig; // to detect params changes
+    std::string serializedParamsBuffer; // reused, to not allocate every tick
+    void resetInternals();
+    void setProfilingOutput();
 };
 
 } // namespace MRA::internal::FVC
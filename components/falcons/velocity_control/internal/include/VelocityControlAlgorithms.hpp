@@ -10,19 +10,53 @@
 
 #include "VelocityControlData.hpp"
 #include "AbstractVelocitySetpointController.hpp"
+#include <chrono>
+#include <tuple>
 
 /*!
- * \brief is the abstract class that each VelocityControl algorithm should inherit.
+ * \brief is a step in a chain of VelocityControl algorithms.
  *
+ * Each algorithm is a plain class with a method execute(VelocityControlData &).
+ * The chain is composed at compile time (see VelocityControl.hpp), so the calls can be inlined.
+ * When an algorithm raises data.done, the remaining steps are skipped, except for the unskippable ones.
+ * Each algorithm has a name, used for profiling (see Params profiling).
  */
-class VelocityControlAlgorithm
+template <typename Algorithm, bool Unskippable = false>
+struct AlgorithmStep
 {
-public:
-    VelocityControlAlgorithm() {}
-
-    virtual void execute(VelocityControlData &data) = 0;
+    Algorithm algorithm;
+
+    void execute(VelocityControlData &data)
+    {
+        if (!data.done || Unskippable)
+        {
+            if (data.profiling.enabled)
+            {
+                auto start = std::chrono::steady_clock::now();
+                algorithm.execute(data);
+                data.profiling.add(Algorithm::name, std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+            }
+            else
+            {
+                algorithm.execute(data);
+            }
+            data.num_algorithms_executed++;
+        }
+    }
+};
 
-    bool unskippable = false;
+template <typename... Steps>
+class AlgorithmChain
+{
+public:
+    void execute(VelocityControlData &data)
+    {
+        // in sequence
+        std::apply([&data](auto &... step) { (step.execute(data), ...); }, steps);
+    }
+
+private:
+    std::tuple<Steps...> steps;
 };
 
 
@@ -31,63 +65,87 @@ public:
 // check that input contains valid data (no z,rx,ry)
 // determine control mode: POSVEL, POS_ONLY or VEL_ONLY
 // set internal variables based on inputs, state, params
-class CheckPrepareInputs : public VelocityControlAlgorithm
+class CheckPrepareInputs
 {
+public:
+    static constexpr char const *name = "CheckPrepareInputs";
     void execute(VelocityControlData &data);
 
+private:
     void checkWorldState(VelocityControlData &data);
     MRA::FalconsVelocityControl::ControlModeEnum checkTargetSetpoint(VelocityControlData &data);
     void setInternalVariables(VelocityControlData &data);
 };
 
 // determine the limits to use based on configuration and input motion profile
-class ConfigureLimits : public VelocityControlAlgorithm
+class ConfigureLimits
 {
+public:
+    static constexpr char const *name = "ConfigureLimits";
     void execute(VelocityControlData &data);
+
+    // precalculate data.limitsTable from data.config, to be called when params change
+    static void createTable(VelocityControlData &data);
 };
 
 // check if a STOP command was given
-class CheckStop : public VelocityControlAlgorithm
+class CheckStop
 {
+public:
+    static constexpr char const *name = "CheckStop";
     void execute(VelocityControlData &data);
 };
 
 // prevent runaway setpoints by ensuring that last call was recent enough
-class Watchdog : public VelocityControlAlgorithm
+class Watchdog
 {
+public:
+    static constexpr char const *name = "Watchdog";
     void execute(VelocityControlData &data);
 };
 
 // to enable dribbling, limits should apply to ball, not robot
-class ShiftBallOffset : public VelocityControlAlgorithm
+class ShiftBallOffset
 {
+public:
+    static constexpr char const *name = "ShiftBallOffset";
     void execute(VelocityControlData &data);
 };
-class UnShiftBallOffset : public VelocityControlAlgorithm
+class UnShiftBallOffset
 {
+public:
+    static constexpr char const *name = "UnShiftBallOffset";
     void execute(VelocityControlData &data);
 };
 
 // velocity control (in FCS or RCS, depends on configuration)
 // for now: always SPG (SetPointGenerator) using Reflexxes Type II library
-class SelectVelocityController : public VelocityControlAlgorithm
+class SelectVelocityController
 {
+public:
+    static constexpr char const *name = "SelectVelocityController";
     void execute(VelocityControlData &data);
 };
-class CalculateVelocity : public VelocityControlAlgorithm
+class CalculateVelocity
 {
+public:
+    static constexpr char const *name = "CalculateVelocity";
     void execute(VelocityControlData &data);
 };
 
 // prevent wasting energy by responding to very small setpoints
-class Deadzone : public VelocityControlAlgorithm
+class Deadzone
 {
+public:
+    static constexpr char const *name = "Deadzone";
     void execute(VelocityControlData &data);
 };
 
 // write state variables to be used in next iteration
-class SetOutputsPrepareNext : public VelocityControlAlgorithm
+class SetOutputsPrepareNext
 {
+public:
+    static constexpr char const *name = "SetOutputsPrepareNext";
     void execute(VelocityControlData &data);
 };
 
@@ -0,0 +1,100 @@
+/*
+ * VelocityControlBatch.hpp
+ *
+ *  Created on: October 2026
+ */
+
+#ifndef VELOCITYCONTROLBATCH_HPP_
+#define VELOCITYCONTROLBATCH_HPP_
+
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "VelocityControl.hpp"
+
+
+namespace MRA::internal::FVC
+{
+
+// run VelocityControl for a batch of robots (or simulated rollouts) sharing the same params
+// each item has its own input (worldstate, setpoint, motion profile) and state, like a regular tick
+// compared to ticking the component per item, the pipelines (and their Reflexxes objects) are pooled
+// and there is no tick logging per item: only failed items are logged (index and exception),
+// plus one summary entry per batch
+// items are independent (no information is carried from one tick to the next other than via State),
+// so they can be distributed over threads, each thread uses its own pipeline
+// the extra threads are started once and wait for work in between batches, so small batches only pay for a handover
+class VelocityControlBatch
+{
+public:
+    VelocityControlBatch(int numExtraThreads = 0);
+    ~VelocityControlBatch();
+
+    // run all items, multithreaded if so constructed
+    // params are shared by all items, pipelines are only reconfigured when params change (see VelocityControl::configure)
+    // states are updated in place, new items start with an empty state
+    // states, outputs, locals and errorValues are resized to the number of inputs,
+    // the output messages are owned by the caller, so when reused their memory is reused as well
+    // error value per item is 0 on success, -1 when the item raised an exception (as the component tick, which is logged)
+    // return the number of failed items
+    // not reentrant: one batch at a time per object
+    int run(
+        MRA_timestamp const &timestamp,
+        MRA_ParamsType const &params,
+        std::vector<MRA_InputType> const &inputs,
+        std::vector<MRA_StateType> &states,
+        std::vector<MRA_OutputType> &outputs,
+        std::vector<MRA_LocalType> &locals,
+        std::vector<int> &errorValues);
+
+private:
+    // one pipeline per stripe of items, stripe 0 runs on the calling thread
+    std::vector<std::unique_ptr<VelocityControl>> _pipelines;
+
+    // arguments of the current batch, shared with the workers
+    struct Job
+    {
+        MRA_timestamp const *timestamp = nullptr;
+        MRA_ParamsType const *params = nullptr;
+        std::vector<MRA_InputType> const *inputs = nullptr;
+        std::vector<MRA_StateType> *states = nullptr;
+        std::vector<MRA_OutputType> *outputs = nullptr;
+        std::vector<MRA_LocalType> *locals = nullptr;
+        std::vector<int> *errorValues = nullptr;
+        int numStripes = 0;
+    };
+
+    // persistent worker threads, worker i runs stripe i+1
+    // a batch is handed over by increasing the generation, each worker reports back by decreasing the pending count
+    std::vector<std::thread> _workers;
+    std::mutex _mutex;
+    std::condition_variable _workAvailable;
+    std::condition_variable _workDone;
+    Job _job;
+    uint64_t _generation = 0;
+    int _pending = 0;
+    bool _stop = false;
+
+    void workerLoop(int stripe);
+
+    void runStripe(
+        VelocityControl &pipeline,
+        int begin,
+        int end,
+        MRA_timestamp const &timestamp,
+        MRA_ParamsType const &params,
+        std::vector<MRA_InputType> const &inputs,
+        std::vector<MRA_StateType> &states,
+        std::vector<MRA_OutputType> &outputs,
+        std::vector<MRA_LocalType> &locals,
+        std::vector<int> &errorValues);
+};
+
+} // namespace MRA::internal::FVC
+
+#endif
+
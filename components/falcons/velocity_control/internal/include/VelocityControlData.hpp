@@ -10,6 +10,7 @@
 
 // MRA libraries
 #include "MRAbridge.hpp"
+#include "VelocityTrajectory.hpp"
 
 // forward declaration
 class AbstractVelocitySetpointController;
@@ -17,16 +18,74 @@ class AbstractVelocitySetpointController;
 namespace MRA::internal::FVC
 {
 
+// flat (POD) equivalents of the Limits configuration, to not use protobuf on the tick path
+struct XYRzLimitValues
+{
+    double x = 0.0;
+    double y = 0.0;
+    double rz = 0.0;
+    double yforward = 0.0;
+    double ybackward = 0.0;
+};
+
+struct MotionLimits
+{
+    XYRzLimitValues maxVel;
+    XYRzLimitValues maxAcc;
+    XYRzLimitValues maxDec;
+    XYRzLimitValues accThreshold;
+};
+
+// optional profiling of a tick, see Params profiling
+// counters are cheap so they are always maintained, timing is only measured when enabled
+struct Profiling
+{
+    struct AlgorithmDuration
+    {
+        char const *name = nullptr;
+        double duration = 0.0; // [seconds]
+    };
+
+    bool enabled = false;
+    std::array<AlgorithmDuration, 16> algorithms;
+    int numAlgorithms = 0;
+    int spgCalculations = 0;
+    int spgRecalculations = 0;
+    int spgSolves = 0;
+    int spgFinalStateReached = 0;
+    int spgErrors = 0;
+
+    void reset()
+    {
+        numAlgorithms = 0;
+        spgCalculations = 0;
+        spgRecalculations = 0;
+        spgSolves = 0;
+        spgFinalStateReached = 0;
+        spgErrors = 0;
+    }
+
+    void add(char const *name, double duration)
+    {
+        if (numAlgorithms < (int)algorithms.size())
+        {
+            algorithms[numAlgorithms++] = AlgorithmDuration{name, duration};
+        }
+    }
+};
+
 // this struct is used (r/w) by every algorithm
 struct VelocityControlData
 {
     // MRA interface
-    MRA_timestamp      timestamp;
-    MRA_InputType      input;
-    MRA_ParamsType     config;
-    MRA_StateType      state;
-    MRA_LocalType      diag;
-    MRA_OutputType     output;
+    // configuration is owned, it only changes when the pipeline is reconfigured (see VelocityControl::configure)
+    // the other data is owned by the caller and only referred to during a tick, to avoid copying protobuf messages
+    MRA_timestamp          timestamp;
+    MRA_InputType  const  *input = nullptr;
+    MRA_ParamsType         config;
+    MRA_StateType         *state = nullptr;
+    MRA_LocalType         *diag = nullptr;
+    MRA_OutputType        *output = nullptr;
 
     // while running the sequence of algorithms, this flag may be raised
     bool done;
@@ -34,11 +93,16 @@ struct VelocityControlData
     // which controller to use, determined by the SelectVelocityController algorithm
     std::shared_ptr<AbstractVelocitySetpointController> controller;
 
+    // merged limits for every (motionProfile, hasBall) combination, index 2 * motionProfile + hasBall
+    // calculated when params change, see ConfigureLimits::createTable
+    std::vector<MotionLimits> limitsTable;
+
     // set the limits based on full configuration and input
-    MRA::FalconsVelocityControl::Limits limits;
+    MotionLimits limits;
 
     // internal variables
     int num_algorithms_executed;
+    Profiling profiling;
     MRA::FalconsVelocityControl::ControlModeEnum controlMode;
     Position2D currentPositionFcs;
     Velocity2D currentVelocityFcs;
@@ -49,6 +113,7 @@ struct VelocityControlData
 
     // result
     Velocity2D resultVelocityRcs;
+    VelocityTrajectory resultTrajectoryRcs; // only described when configured, see Params trajectory
 
 };
 
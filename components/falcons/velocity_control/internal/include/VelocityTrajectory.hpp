@@ -0,0 +1,151 @@
+/*
+ * VelocityTrajectory.hpp
+ *
+ *  Created on: October 2026
+ */
+
+#ifndef VELOCITYTRAJECTORY_HPP_
+#define VELOCITYTRAJECTORY_HPP_
+
+#include "MRAbridge.hpp"
+#include <algorithm>
+#include <array>
+#include <cmath>
+
+
+namespace MRA::internal::FVC
+{
+
+// velocity setpoint trajectory in RCS, as consecutive segments of constant acceleration
+// (Reflexxes TypeII trajectories have piecewise constant acceleration)
+// time 0 corresponds to the velocity output of the tick, velocities are in RCS at the time of the tick
+// flat (POD) equivalent of the Output Trajectory, with fixed capacity, to not allocate on the tick path
+struct VelocityTrajectory
+{
+    struct Segment
+    {
+        double duration = 0.0;
+        Velocity2D velocity; // at the start of the segment
+        Velocity2D acceleration;
+    };
+
+    static constexpr int MAX_SEGMENTS = 16;
+    std::array<Segment, MAX_SEGMENTS> segments;
+    int numSegments = 0;
+
+    void reset()
+    {
+        numSegments = 0;
+    }
+
+    bool full() const
+    {
+        return numSegments == MAX_SEGMENTS;
+    }
+
+    double duration() const
+    {
+        double result = 0.0;
+        for (int it = 0; it < numSegments; ++it)
+        {
+            result += segments[it].duration;
+        }
+        return result;
+    }
+
+    // append a segment, or extend the last one when the acceleration is the same
+    // return false when there is no room left
+    bool add(double duration, Velocity2D const &velocity, Velocity2D const &acceleration)
+    {
+        double const tolerance = 1e-6;
+        if (numSegments > 0)
+        {
+            Segment &last = segments[numSegments - 1];
+            if (   fabs(last.acceleration.x - acceleration.x) < tolerance
+                && fabs(last.acceleration.y - acceleration.y) < tolerance
+                && fabs(last.acceleration.rz - acceleration.rz) < tolerance)
+            {
+                last.duration += duration;
+                return true;
+            }
+        }
+        if (full())
+        {
+            return false;
+        }
+        segments[numSegments++] = Segment{duration, velocity, acceleration};
+        return true;
+    }
+
+    void setConstant(double duration, Velocity2D const &velocity)
+    {
+        reset();
+        add(duration, velocity, Velocity2D());
+    }
+
+    // convert velocities in place, for instance when unshifting the ball offset
+    template <typename Conversion>
+    void convert(Conversion conversion)
+    {
+        for (int it = 0; it < numSegments; ++it)
+        {
+            conversion(segments[it].velocity);
+            conversion(segments[it].acceleration);
+        }
+    }
+
+    // the output message is owned by the caller, so after the first tick its segments are reused instead of allocated
+    void toProto(MRA::FalconsVelocityControl::Trajectory *trajectory) const
+    {
+        trajectory->set_validity(duration());
+        trajectory->clear_segments();
+        for (int it = 0; it < numSegments; ++it)
+        {
+            auto *segment = trajectory->add_segments();
+            segment->set_duration(segments[it].duration);
+            segment->mutable_velocity()->set_x(segments[it].velocity.x);
+            segment->mutable_velocity()->set_y(segments[it].velocity.y);
+            segment->mutable_velocity()->set_rz(segments[it].velocity.rz);
+            segment->mutable_acceleration()->set_x(segments[it].acceleration.x);
+            segment->mutable_acceleration()->set_y(segments[it].acceleration.y);
+            segment->mutable_acceleration()->set_rz(segments[it].acceleration.rz);
+        }
+    }
+};
+
+// evaluate the velocity setpoint at time t [seconds] after the tick which produced the trajectory
+// intended to be called at a higher rate than the tick, for instance by a motor controller, so it does not allocate
+// beyond the validity of the trajectory, the final velocity is held
+// the result is in RCS at time t: the robot rotates meanwhile, so x,y are rotated back by the integrated rz since the tick
+inline Velocity2D sampleTrajectory(MRA::FalconsVelocityControl::Trajectory const &trajectory, double t)
+{
+    Velocity2D result;
+    double rotation = 0.0;
+    t = std::max(0.0, t);
+    for (auto const &segment: trajectory.segments())
+    {
+        double tSegment = std::min(t, segment.duration());
+        result.x  = segment.velocity().x()  + segment.acceleration().x()  * tSegment;
+        result.y  = segment.velocity().y()  + segment.acceleration().y()  * tSegment;
+        result.rz = segment.velocity().rz() + segment.acceleration().rz() * tSegment;
+        rotation += (segment.velocity().rz() + 0.5 * segment.acceleration().rz() * tSegment) * tSegment;
+        t -= tSegment;
+        if (t <= 0.0)
+        {
+            break;
+        }
+    }
+    rotation += result.rz * t; // final velocity held
+    double c = cos(rotation);
+    double s = sin(rotation);
+    double x = result.x;
+    double y = result.y;
+    result.x = c * x + s * y;
+    result.y = -s * x + c * y;
+    return result;
+}
+
+} // namespace MRA::internal::FVC
+
+#endif
+
@@ -15,75 +15,93 @@ using namespace MRA::internal::FVC;
 
 VelocityControl::VelocityControl()
 {
-    setup();
 }
 
 VelocityControl::~VelocityControl()
 {
 }
 
-void VelocityControl::add_algorithm(std::shared_ptr<VelocityControlAlgorithm> alg, bool unskippable)
+bool VelocityControl::configure(MRA_ParamsType const &params)
 {
-    algorithms.push_back(alg);
-    alg->unskippable = unskippable;
+    params.SerializeToString(&serializedParamsBuffer);
+    if (serializedParamsBuffer == serializedConfig)
+    {
+        return false;
+    }
+    data.config = params;
+    data.profiling.enabled = params.profiling();
+    data.controller.reset(); // reconstructed by SelectVelocityController
+    serializedConfig.clear(); // when the configuration is rejected, it is checked again on the next tick
+    ConfigureLimits::createTable(data);
+    std::swap(serializedParamsBuffer, serializedConfig);
+    return true;
 }
 
-void VelocityControl::setup()
+bool VelocityControl::isConfiguredWith(std::string const &serializedParams) const
 {
-    // the sequence of algorithms matters and is managed here, based on configuration
-    algorithms.clear();
-    bool unskippable = true;
-
-    // check that input contains valid data (no z,rx,ry)
-    // determine control mode: POSVEL, POS_ONLY or VEL_ONLY
-    // set internal variables based on inputs, state, params
-    add_algorithm(std::make_shared<CheckPrepareInputs>());
-
-    // determine the limits to use based on configuration and input motion profile
-    add_algorithm(std::make_shared<ConfigureLimits>());
-
-    // immediately stop when the command is given (hard motor brake instead of SPG rampdown)
-    add_algorithm(std::make_shared<CheckStop>());
-
-    // prevent runaway setpoints by ensuring that last call was recent enough
-//    algorithms.push_back(new Watchdog());
-
-    // prevent wasting energy by responding to very small setpoints
-    add_algorithm(std::make_shared<Deadzone>());
-
-    // to enable dribbling, limits should apply to ball, not robot
-    add_algorithm(std::make_shared<ShiftBallOffset>());
-
-    // velocity control (in FCS or RCS, depends on configuration)
-    // for now: always SPG (SetPointGenerator) using Reflexxes Type II library
-    add_algorithm(std::make_shared<SelectVelocityController>());
-    add_algorithm(std::make_shared<CalculateVelocity>());
-
-    // SPG intrinsically ensures limits are satisfied
-    // if the controller would be PID or Linear, then ApplyLimits would be needed
-    //add_algorithm(std::make_shared<ApplyLimits>());
-
-    // to enable dribbling, limits should apply to ball, not robot
-    add_algorithm(std::make_shared<UnShiftBallOffset>());
+    return serializedParams == serializedConfig;
+}
 
-    // finally, set output data, write state variables to be used in next iteration
-    add_algorithm(std::make_shared<SetOutputsPrepareNext>(), unskippable);
+void VelocityControl::resetInternals()
+{
+    // all internal variables are derived from the inputs each tick, none may leak from the previous tick
+    data.done = false;
+    data.num_algorithms_executed = 0;
+    data.profiling.reset();
+    data.limits = MotionLimits();
+    data.controlMode = MRA::FalconsVelocityControl::ControlModeEnum::INVALID;
+    data.currentPositionFcs.reset();
+    data.currentVelocityFcs.reset();
+    data.targetPositionFcs.reset();
+    data.targetVelocityFcs.reset();
+    data.previousPositionSetpointFcs.reset();
+    data.previousVelocitySetpointFcs.reset();
+    data.resultVelocityRcs.reset();
+    data.resultTrajectoryRcs.reset();
 }
 
 void VelocityControl::iterate()
 {
     // this function assumes all required inputs (Inputs, Params, State) are set under "data"
     // each algorithm performs some operation on the data
+    resetInternals();
 
     // execute the sequence of algorithms
-    data.done = false;
-    data.num_algorithms_executed = 0;
-    for (auto it = algorithms.begin(); it != algorithms.end(); ++it)
+    // the velocity-only chain is selected upfront, the control mode is checked by CheckPrepareInputs in both chains
+    auto const &setpoint = data.input->setpoint();
+    if (setpoint.has_velocity() && !setpoint.has_position())
+    {
+        velOnlyChain.execute(data);
+    }
+    else
+    {
+        defaultChain.execute(data);
+    }
+    setProfilingOutput();
+}
+
+void VelocityControl::setProfilingOutput()
+{
+    // after the sequence of algorithms, so the timing of SetOutputsPrepareNext is included
+    // local data is owned by caller, it may contain data from a previous tick
+    if (!data.profiling.enabled)
+    {
+        data.diag->clear_timing();
+        data.diag->clear_spg();
+        return;
+    }
+    auto *timing = data.diag->mutable_timing();
+    timing->Clear();
+    for (int it = 0; it < data.profiling.numAlgorithms; ++it)
     {
-        if (!data.done || (*it)->unskippable)
-        {
-            (*it)->execute(data);
-            data.num_algorithms_executed++;
-        }
+        auto *algorithm = timing->Add();
+        algorithm->set_algorithm(data.profiling.algorithms[it].name);
+        algorithm->set_duration(data.profiling.algorithms[it].duration);
     }
+    auto *spg = data.diag->mutable_spg();
+    spg->set_calculations(data.profiling.spgCalculations);
+    spg->set_recalculations(data.profiling.spgRecalculations);
+    spg->set_solves(data.profiling.spgSolves);
+    spg->set_finalstatereached(data.profiling.spgFinalStateReached);
+    spg->set_errors(data.profiling.spgErrors);
 }
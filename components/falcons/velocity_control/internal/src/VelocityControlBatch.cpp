@@ -0,0 +1,172 @@
+/*
+ * VelocityControlBatch.cpp
+ *
+ *  Created on: October 2026
+ */
+
+// own package
+#include "VelocityControlBatch.hpp"
+
+// system
+#include <algorithm>
+#include <thread>
+
+// logging, internal code is logged under the component name
+#ifndef MRA_COMPONENT_NAME
+#define MRA_COMPONENT_NAME "FalconsVelocityControl"
+#endif
+#include "logging.hpp"
+
+
+using namespace MRA::internal::FVC;
+
+
+VelocityControlBatch::VelocityControlBatch(int numExtraThreads)
+{
+    // pipelines are long-lived, they keep their Reflexxes objects from one batch to the next
+    int numPipelines = 1 + std::max(0, numExtraThreads);
+    for (int it = 0; it < numPipelines; ++it)
+    {
+        _pipelines.push_back(std::make_unique<VelocityControl>());
+    }
+    for (int stripe = 1; stripe < numPipelines; ++stripe)
+    {
+        _workers.emplace_back(&VelocityControlBatch::workerLoop, this, stripe);
+    }
+}
+
+VelocityControlBatch::~VelocityControlBatch()
+{
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _stop = true;
+    }
+    _workAvailable.notify_all();
+    for (auto &worker: _workers)
+    {
+        worker.join();
+    }
+}
+
+void VelocityControlBatch::workerLoop(int stripe)
+{
+    uint64_t generation = 0;
+    std::unique_lock<std::mutex> lock(_mutex);
+    while (true)
+    {
+        _workAvailable.wait(lock, [&]() { return _stop || _generation != generation; });
+        if (_stop)
+        {
+            return;
+        }
+        generation = _generation;
+        Job job = _job;
+        lock.unlock();
+        if (stripe < job.numStripes)
+        {
+            int numItems = job.inputs->size();
+            runStripe(*_pipelines[stripe], stripe * numItems / job.numStripes, (stripe + 1) * numItems / job.numStripes,
+                *job.timestamp, *job.params, *job.inputs, *job.states, *job.outputs, *job.locals, *job.errorValues);
+        }
+        lock.lock();
+        if (--_pending == 0)
+        {
+            _workDone.notify_one();
+        }
+    }
+}
+
+int VelocityControlBatch::run(
+    MRA_timestamp const &timestamp,
+    MRA_ParamsType const &params,
+    std::vector<MRA_InputType> const &inputs,
+    std::vector<MRA_StateType> &states,
+    std::vector<MRA_OutputType> &outputs,
+    std::vector<MRA_LocalType> &locals,
+    std::vector<int> &errorValues)
+{
+    int numItems = inputs.size();
+    states.resize(numItems);
+    outputs.resize(numItems);
+    locals.resize(numItems);
+    errorValues.assign(numItems, 0);
+
+    // contiguous stripes, each thread writes only into the items of its own stripe
+    // the result does not depend on the amount of threads, since items are independent
+    // the workers are only woken up when there is more than one stripe
+    int numStripes = std::min<int>(numItems, _pipelines.size());
+    bool useWorkers = numStripes > 1;
+    if (useWorkers)
+    {
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _job = Job{&timestamp, &params, &inputs, &states, &outputs, &locals, &errorValues, numStripes};
+            _pending = _workers.size();
+            ++_generation;
+        }
+        _workAvailable.notify_all();
+    }
+    if (numStripes > 0)
+    {
+        runStripe(*_pipelines[0], 0, numItems / numStripes,
+            timestamp, params, inputs, states, outputs, locals, errorValues);
+    }
+    if (useWorkers)
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+        _workDone.wait(lock, [&]() { return _pending == 0; });
+    }
+
+    int numFailed = std::count(errorValues.begin(), errorValues.end(), -1);
+    MRA_LOG_DEBUG("batch of %d items on %d threads, %d failed", numItems, std::max(1, numStripes), numFailed);
+    return numFailed;
+}
+
+void VelocityControlBatch::runStripe(
+    VelocityControl &pipeline,
+    int begin,
+    int end,
+    MRA_timestamp const &timestamp,
+    MRA_ParamsType const &params,
+    std::vector<MRA_InputType> const &inputs,
+    std::vector<MRA_StateType> &states,
+    std::vector<MRA_OutputType> &outputs,
+    std::vector<MRA_LocalType> &locals,
+    std::vector<int> &errorValues)
+{
+    // same as the component tick, except that the configuration is only checked once per stripe
+    // when the configuration is rejected, it is checked again for the next item, so all items fail as if ticked individually
+    bool configured = false;
+    pipeline.data.timestamp = timestamp;
+    for (int it = begin; it < end; ++it)
+    {
+        pipeline.data.input = &inputs[it];
+        pipeline.data.state = &states[it];
+        pipeline.data.output = &outputs[it];
+        pipeline.data.diag = &locals[it];
+        try
+        {
+            if (!configured)
+            {
+                pipeline.configure(params);
+                configured = true;
+            }
+            pipeline.iterate();
+        }
+        catch (std::exception const &e)
+        {
+            MRA_LOG_ERROR("ERROR: Caught a standard exception at batch item %d: %s", it, e.what());
+            errorValues[it] = -1;
+        }
+        catch (...)
+        {
+            MRA_LOG_ERROR("ERROR: Caught an unknown exception at batch item %d.", it);
+            errorValues[it] = -1;
+        }
+    }
+    pipeline.data.input = nullptr;
+    pipeline.data.state = nullptr;
+    pipeline.data.output = nullptr;
+    pipeline.data.diag = nullptr;
+}
+
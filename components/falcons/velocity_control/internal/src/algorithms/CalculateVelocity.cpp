@@ -40,18 +40,23 @@ void CalculateVelocity::execute(VelocityControlData &data)
         bool xySPGConverged = ((abs(data.resultVelocityRcs.x) < tolerance) && (abs(data.resultVelocityRcs.y) < tolerance));
         bool rzSPGConverged = (abs(data.resultVelocityRcs.rz) < tolerance);
         // run linear controller
-        VelocityControlData tmpdata = data;
-        LinearVelocitySetpointController().calculate(tmpdata);
+        // (it only writes resultVelocityRcs, so instead of copying all data, keep the SPG result aside)
+        Velocity2D spgResultVelocityRcs = data.resultVelocityRcs;
+        LinearVelocitySetpointController().calculate(data);
+        Velocity2D linearResultVelocityRcs = data.resultVelocityRcs;
+        data.resultVelocityRcs = spgResultVelocityRcs;
         // overrule XY?
         if (xySPGConverged && !xyDeltaSmallEnough)
         {
-            data.resultVelocityRcs.x = tmpdata.resultVelocityRcs.x;
-            data.resultVelocityRcs.y = tmpdata.resultVelocityRcs.y;
+            data.resultVelocityRcs.x = linearResultVelocityRcs.x;
+            data.resultVelocityRcs.y = linearResultVelocityRcs.y;
+            data.resultTrajectoryRcs.reset(); // no longer the SPG trajectory
         }
         // overrule Rz?
         if (rzSPGConverged && !rzDeltaSmallEnough)
         {
-            data.resultVelocityRcs.rz = tmpdata.resultVelocityRcs.rz;
+            data.resultVelocityRcs.rz = linearResultVelocityRcs.rz;
+            data.resultTrajectoryRcs.reset();
         }
     }
 }
@@ -24,7 +24,7 @@ void CheckPrepareInputs::execute(VelocityControlData &data)
 void CheckPrepareInputs::checkWorldState(VelocityControlData &data)
 {
     // stop further processing if robot is set to inactive
-    if (!data.input.worldstate().robot().active())
+    if (!data.input->worldstate().robot().active())
     {
         data.done = true;
         //throw VelocityControlExceptions::RobotInactive(__FILE__, __LINE__);
@@ -33,8 +33,8 @@ void CheckPrepareInputs::checkWorldState(VelocityControlData &data)
 
     // check that robot position and velocity are set
     // (protobuf v3 does not allow checks on scalar level, it is valid to omit, in which case zeros are assumed)
-    if (!data.input.worldstate().robot().has_position()) throw VelocityControlExceptions::IncompleteInput(__FILE__, __LINE__, "robot position");
-    if (!data.input.worldstate().robot().has_velocity()) throw VelocityControlExceptions::IncompleteInput(__FILE__, __LINE__, "robot velocity");
+    if (!data.input->worldstate().robot().has_position()) throw VelocityControlExceptions::IncompleteInput(__FILE__, __LINE__, "robot position");
+    if (!data.input->worldstate().robot().has_velocity()) throw VelocityControlExceptions::IncompleteInput(__FILE__, __LINE__, "robot velocity");
 
     // checks on target setpoint are done in another function
 }
@@ -43,9 +43,9 @@ MRA::FalconsVelocityControl::ControlModeEnum CheckPrepareInputs::checkTargetSetp
 {
     // check if target position and/or velocity are set
     MRA::FalconsVelocityControl::ControlModeEnum result = MRA::FalconsVelocityControl::ControlModeEnum::INVALID;
-    if (data.input.setpoint().has_position())
+    if (data.input->setpoint().has_position())
     {
-        if (data.input.setpoint().has_velocity())
+        if (data.input->setpoint().has_velocity())
         {
             result = MRA::FalconsVelocityControl::ControlModeEnum::POSVEL;
         }
@@ -54,7 +54,7 @@ MRA::FalconsVelocityControl::ControlModeEnum CheckPrepareInputs::checkTargetSetp
             result = MRA::FalconsVelocityControl::ControlModeEnum::POS_ONLY;
         }
     }
-    else if (data.input.setpoint().has_velocity())
+    else if (data.input->setpoint().has_velocity())
     {
         result = MRA::FalconsVelocityControl::ControlModeEnum::VEL_ONLY;
     }
@@ -65,24 +65,24 @@ MRA::FalconsVelocityControl::ControlModeEnum CheckPrepareInputs::checkTargetSetp
     }
 
     // check for invalid dimensions -- robot cannot fly (yet ;))
-    if (data.input.setpoint().position().z() != 0)  throw VelocityControlExceptions::UnsupportedDimension(__FILE__, __LINE__, "setpoint position.z");
-    if (data.input.setpoint().position().rx() != 0) throw VelocityControlExceptions::UnsupportedDimension(__FILE__, __LINE__, "setpoint position.rx");
-    if (data.input.setpoint().position().ry() != 0) throw VelocityControlExceptions::UnsupportedDimension(__FILE__, __LINE__, "setpoint position.ry");
-    if (data.input.setpoint().velocity().z() != 0)  throw VelocityControlExceptions::UnsupportedDimension(__FILE__, __LINE__, "setpoint velocity.z");
-    if (data.input.setpoint().velocity().rx() != 0) throw VelocityControlExceptions::UnsupportedDimension(__FILE__, __LINE__, "setpoint velocity.rx");
-    if (data.input.setpoint().velocity().ry() != 0) throw VelocityControlExceptions::UnsupportedDimension(__FILE__, __LINE__, "setpoint velocity.ry");
+    if (data.input->setpoint().position().z() != 0)  throw VelocityControlExceptions::UnsupportedDimension(__FILE__, __LINE__, "setpoint position.z");
+    if (data.input->setpoint().position().rx() != 0) throw VelocityControlExceptions::UnsupportedDimension(__FILE__, __LINE__, "setpoint position.rx");
+    if (data.input->setpoint().position().ry() != 0) throw VelocityControlExceptions::UnsupportedDimension(__FILE__, __LINE__, "setpoint position.ry");
+    if (data.input->setpoint().velocity().z() != 0)  throw VelocityControlExceptions::UnsupportedDimension(__FILE__, __LINE__, "setpoint velocity.z");
+    if (data.input->setpoint().velocity().rx() != 0) throw VelocityControlExceptions::UnsupportedDimension(__FILE__, __LINE__, "setpoint velocity.rx");
+    if (data.input->setpoint().velocity().ry() != 0) throw VelocityControlExceptions::UnsupportedDimension(__FILE__, __LINE__, "setpoint velocity.ry");
 
     return result;
 }
 
 void CheckPrepareInputs::setInternalVariables(VelocityControlData &data)
 {
-    data.currentPositionFcs = MRA::Geometry::Position(data.input.worldstate().robot().position());
-    data.currentVelocityFcs = MRA::Geometry::Velocity(data.input.worldstate().robot().velocity());
-    data.targetPositionFcs  = MRA::Geometry::Position(data.input.setpoint().position());
-    data.targetVelocityFcs  = MRA::Geometry::Velocity(data.input.setpoint().velocity());
+    data.currentPositionFcs = MRA::Geometry::Position(data.input->worldstate().robot().position());
+    data.currentVelocityFcs = MRA::Geometry::Velocity(data.input->worldstate().robot().velocity());
+    data.targetPositionFcs  = MRA::Geometry::Position(data.input->setpoint().position());
+    data.targetVelocityFcs  = MRA::Geometry::Velocity(data.input->setpoint().velocity());
 
-    data.previousPositionSetpointFcs = MRA::Geometry::Position(data.state.positionsetpointfcs());
-    data.previousVelocitySetpointFcs = MRA::Geometry::Velocity(data.state.velocitysetpointfcs());
+    data.previousPositionSetpointFcs = MRA::Geometry::Position(data.state->positionsetpointfcs());
+    data.previousVelocitySetpointFcs = MRA::Geometry::Velocity(data.state->velocitysetpointfcs());
 }
 
@@ -7,44 +7,132 @@
 
 #include "VelocityControlAlgorithms.hpp"
 #include "VelocityControlExceptions.hpp"
+#include <cmath>
 
 
-void ConfigureLimits::execute(VelocityControlData &data)
+static XYRzLimitValues flatten(MRA::FalconsVelocityControl::XYRzLimits const &limits)
 {
-    // check that at least one set of limits is configured
-    int num_motionprofiles = data.config.limits().size();
-    if (num_motionprofiles == 0)
+    XYRzLimitValues result;
+    result.x = limits.x();
+    result.y = limits.y();
+    result.rz = limits.rz();
+    result.yforward = limits.yforward();
+    result.ybackward = limits.ybackward();
+    return result;
+}
+
+static MotionLimits mergeLimits(MRA_ParamsType const &config, int motionprofile)
+{
+    // fill limits based on default motion profile
+    // then, use requested motionprofile to overrule
+    // doing this after filling based on the default set (index 0) helps to keep the configuration clean
+    MRA::FalconsVelocityControl::Limits limits;
+    limits.CopyFrom(config.limits(0));
+    limits.MergeFrom(config.limits(motionprofile));
+    // TODO: setting some value to zero might not work in protobuf v3 with this code
+    MotionLimits result;
+    result.maxVel = flatten(limits.maxvel());
+    result.maxAcc = flatten(limits.maxacc());
+    result.maxDec = flatten(limits.maxdec());
+    result.accThreshold = flatten(limits.accthreshold());
+    return result;
+}
+
+static double maxWheelVelocity(MRA_ParamsType const &config, XYRzLimitValues const &maxVel, bool withBall)
+{
+    // omni-wheel kinematics: a wheel at angle a around the robot center, at distance d, drives perpendicular to its radius
+    // wheel velocity = -sin(a) * vx + cos(a) * vy + d * vrz
+    // which, over all velocities within the limits, is maximal at a corner of the limits box
+    auto const &motorLimits = config.motorlimits();
+    double vx = maxVel.x;
+    double vy = std::max(maxVel.yforward, maxVel.ybackward);
+    double vrz = maxVel.rz;
+    double vxOffset = 0.0;
+    if (withBall && config.dribble().applylimitstoball())
     {
-        throw VelocityControlExceptions::IncompleteConfiguration(__FILE__, __LINE__, "require at least one set of motionprofile limits");
+        // limits apply to the ball, robot vx is the ball vx plus the rotation around it (see UnShiftBallOffset)
+        vxOffset = vrz * config.dribble().radiusrobottoball();
+    }
+    double result = 0.0;
+    for (double angle: motorLimits.wheelangles())
+    {
+        double wheelVelocity = fabs(sin(angle)) * (vx + vxOffset) + fabs(cos(angle)) * vy + motorLimits.wheeldistance() * vrz;
+        result = std::max(result, wheelVelocity);
     }
+    return result;
+}
 
-    // on input, user can select which motion profile to use, default 0
-    int motionprofile = data.input.motionprofile();
-    if (motionprofile < 0 || motionprofile >= num_motionprofiles)
+static void applyMotorLimits(MRA_ParamsType const &config, MotionLimits &limits, bool withBall)
+{
+    // scale the velocity limits in closed form, so every velocity setpoint within them is feasible for all wheels
+    // (all wheel velocities are linear in the setpoint, so scaling the limits scales the wheel velocities)
+    double wheelVelocity = maxWheelVelocity(config, limits.maxVel, withBall);
+    if (wheelVelocity <= config.motorlimits().maxwheelvelocity())
     {
-        throw VelocityControlExceptions::InvalidInput(__FILE__, __LINE__, "invalid motionprofile requested: " + std::to_string(motionprofile)
-            + " (number of configured motionprofiles: " + std::to_string(num_motionprofiles) + ")");
+        return;
     }
+    double factor = config.motorlimits().maxwheelvelocity() / wheelVelocity;
+    limits.maxVel.x *= factor;
+    limits.maxVel.y *= factor;
+    limits.maxVel.rz *= factor;
+    limits.maxVel.yforward *= factor;
+    limits.maxVel.ybackward *= factor;
+}
+
+void ConfigureLimits::createTable(VelocityControlData &data)
+{
+    data.limitsTable.clear();
+    int num_motionprofiles = data.config.limits().size();
 
     // when robot has the ball, and if input motion profile is default (0),
     // then automatically choose a set of motion profiles called 'withBall' from the configured non-default motion profiles
     std::string expected_withball_name = "withBall"; // TODO: allow more names? this is a little bit magic.
-    if (data.input.worldstate().robot().hasball() && motionprofile == 0)
+    int withball_motionprofile = 0;
+    for (int tmp_motionprofile = 1; tmp_motionprofile < num_motionprofiles; ++tmp_motionprofile)
     {
-        for (int tmp_motionprofile = 1; tmp_motionprofile < num_motionprofiles; ++tmp_motionprofile)
+        if (data.config.limits(tmp_motionprofile).name() == expected_withball_name)
         {
-            if (data.config.limits(tmp_motionprofile).name() == expected_withball_name)
-            {
-                motionprofile = tmp_motionprofile;
-            }
+            withball_motionprofile = tmp_motionprofile;
         }
     }
 
-    // fill limits based on default motion profile
-    // then, use requested motionprofile to overrule
-    // doing this after filling based on the default set (index 0) helps to keep the configuration clean
-    data.limits.CopyFrom(data.config.limits(0));
-    data.limits.MergeFrom(data.config.limits(motionprofile));
-    // TODO: setting some value to zero might not work in protobuf v3 with this code
+    // optional motor limits (feasible wheel velocities) are applied on the velocity limits, so the SPG only needs one run
+    auto const &motorLimits = data.config.motorlimits();
+    if (motorLimits.enabled() && (motorLimits.wheelangles().empty() || motorLimits.maxwheelvelocity() <= 0.0))
+    {
+        throw VelocityControlExceptions::IncompleteConfiguration(__FILE__, __LINE__, "motorLimits require wheelAngles and a positive maxWheelVelocity");
+    }
+
+    for (int motionprofile = 0; motionprofile < num_motionprofiles; ++motionprofile)
+    {
+        data.limitsTable.push_back(mergeLimits(data.config, motionprofile)); // without ball
+        data.limitsTable.push_back(mergeLimits(data.config, (motionprofile == 0) ? withball_motionprofile : motionprofile)); // with ball
+        if (motorLimits.enabled())
+        {
+            applyMotorLimits(data.config, data.limitsTable.end()[-2], false);
+            applyMotorLimits(data.config, data.limitsTable.end()[-1], true);
+        }
+    }
 }
 
+void ConfigureLimits::execute(VelocityControlData &data)
+{
+    // check that at least one set of limits is configured
+    int num_motionprofiles = data.limitsTable.size() / 2;
+    if (num_motionprofiles == 0)
+    {
+        throw VelocityControlExceptions::IncompleteConfiguration(__FILE__, __LINE__, "require at least one set of motionprofile limits");
+    }
+
+    // on input, user can select which motion profile to use, default 0
+    int motionprofile = data.input->motionprofile();
+    if (motionprofile < 0 || motionprofile >= num_motionprofiles)
+    {
+        throw VelocityControlExceptions::InvalidInput(__FILE__, __LINE__, "invalid motionprofile requested: " + std::to_string(motionprofile)
+            + " (number of configured motionprofiles: " + std::to_string(num_motionprofiles) + ")");
+    }
+
+    // the table has been prepared on configuration, see createTable
+    bool hasball = data.input->worldstate().robot().hasball();
+    data.limits = data.limitsTable[2 * motionprofile + hasball];
+}
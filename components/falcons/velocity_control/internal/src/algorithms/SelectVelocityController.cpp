@@ -12,6 +12,10 @@
 
 void SelectVelocityController::execute(VelocityControlData &data)
 {
-    data.controller = std::shared_ptr<AbstractVelocitySetpointController>(new SPGVelocitySetpointController());
+    // the controller is kept for subsequent ticks, it is released when the pipeline is reconfigured
+    if (!data.controller)
+    {
+        data.controller = std::shared_ptr<AbstractVelocitySetpointController>(new SPGVelocitySetpointController());
+    }
 }
 
@@ -10,18 +10,32 @@
 
 void SetOutputsPrepareNext::execute(VelocityControlData &data)
 {
-    data.output.mutable_velocity()->set_x(data.resultVelocityRcs.x);
-    data.output.mutable_velocity()->set_y(data.resultVelocityRcs.y);
-    data.output.mutable_velocity()->set_rz(data.resultVelocityRcs.rz);
+    data.output->mutable_velocity()->Clear(); // output is owned by caller, it may contain data from a previous tick
+    data.output->mutable_velocity()->set_x(data.resultVelocityRcs.x);
+    data.output->mutable_velocity()->set_y(data.resultVelocityRcs.y);
+    data.output->mutable_velocity()->set_rz(data.resultVelocityRcs.rz);
+    if (data.config.trajectory().enabled())
+    {
+        // a controller which does not describe its trajectory (or an early exit, like stop or deadzone) gives a constant velocity
+        if (data.resultTrajectoryRcs.numSegments == 0)
+        {
+            data.resultTrajectoryRcs.setConstant(std::max(data.config.trajectory().horizon(), data.config.dt()), data.resultVelocityRcs);
+        }
+        data.resultTrajectoryRcs.toProto(data.output->mutable_trajectory());
+    }
+    else
+    {
+        data.output->clear_trajectory();
+    }
 
-    data.state.mutable_positionsetpointfcs()->set_x(data.previousPositionSetpointFcs.x);
-    data.state.mutable_positionsetpointfcs()->set_y(data.previousPositionSetpointFcs.y);
-    data.state.mutable_positionsetpointfcs()->set_rz(data.previousPositionSetpointFcs.rz);
-    data.state.mutable_velocitysetpointfcs()->set_x(data.previousVelocitySetpointFcs.x);
-    data.state.mutable_velocitysetpointfcs()->set_y(data.previousVelocitySetpointFcs.y);
-    data.state.mutable_velocitysetpointfcs()->set_rz(data.previousVelocitySetpointFcs.rz);
+    data.state->mutable_positionsetpointfcs()->set_x(data.previousPositionSetpointFcs.x);
+    data.state->mutable_positionsetpointfcs()->set_y(data.previousPositionSetpointFcs.y);
+    data.state->mutable_positionsetpointfcs()->set_rz(data.previousPositionSetpointFcs.rz);
+    data.state->mutable_velocitysetpointfcs()->set_x(data.previousVelocitySetpointFcs.x);
+    data.state->mutable_velocitysetpointfcs()->set_y(data.previousVelocitySetpointFcs.y);
+    data.state->mutable_velocitysetpointfcs()->set_rz(data.previousVelocitySetpointFcs.rz);
 
-    data.diag.set_controlmode(data.controlMode);
-    data.diag.set_numalgorithmsexecuted(data.num_algorithms_executed);
+    data.diag->set_controlmode(data.controlMode);
+    data.diag->set_numalgorithmsexecuted(data.num_algorithms_executed);
 }
 
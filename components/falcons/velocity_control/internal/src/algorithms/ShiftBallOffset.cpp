@@ -15,7 +15,7 @@
 void ShiftBallOffset::execute(VelocityControlData &data)
 {
     // add ball offset, if applicable
-    if (data.input.worldstate().has_ball() && data.config.dribble().applylimitstoball())
+    if (data.input->worldstate().has_ball() && data.config.dribble().applylimitstoball())
     {
         auto offset = MRA::Geometry::Pose(0.0, data.config.dribble().radiusrobottoball(), 0.0);
         data.targetPositionFcs.addRcsToFcs(offset);
@@ -27,12 +27,14 @@ void ShiftBallOffset::execute(VelocityControlData &data)
 void UnShiftBallOffset::execute(VelocityControlData &data)
 {
     // subtract ball offset, if applicable
-    if (data.input.worldstate().has_ball() && data.config.dribble().applylimitstoball())
+    if (data.input->worldstate().has_ball() && data.config.dribble().applylimitstoball())
     {
         // resultVelocityRcs applies to the ball
         // convert to motor setpoint
         // this used to be called TokyoDrift
-        data.resultVelocityRcs.x += data.resultVelocityRcs.rz * data.config.dribble().radiusrobottoball();
+        double radius = data.config.dribble().radiusrobottoball();
+        data.resultVelocityRcs.x += data.resultVelocityRcs.rz * radius;
+        data.resultTrajectoryRcs.convert([radius](Velocity2D &v) { v.x += v.rz * radius; });
 
         // unshift coordinates
         // - SPG 'feedforward' data update
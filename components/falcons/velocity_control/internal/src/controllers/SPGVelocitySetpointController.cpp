@@ -10,6 +10,7 @@
 #include "SPGVelocitySetpointController.hpp"
 
 #include <algorithm>
+#include <limits>
 
 SPGVelocitySetpointController::SPGVelocitySetpointController()
 {
@@ -19,23 +20,34 @@ SPGVelocitySetpointController::~SPGVelocitySetpointController()
 {
 }
 
+void SPGVelocitySetpointController::prepareObjects(double dt)
+{
+    if (_posXYRz && dt == _dt)
+    {
+        return;
+    }
+    _dt = dt;
+    _posXYRz = std::make_unique<SpgPositionObjects>(3, dt); // X, Y, Rz
+    _posXYRz->Flags.SynchronizationBehavior = RMLPositionFlags::PHASE_SYNCHRONIZATION_IF_POSSIBLE;
+    _posXYRz->Flags.BehaviorAfterFinalStateOfMotionIsReached = RMLPositionFlags::RECOMPUTE_TRAJECTORY;
+    _posSRz = std::make_unique<SpgPositionObjects>(2, dt); // XY along a direction, Rz
+    _posSRz->Flags.SynchronizationBehavior = RMLPositionFlags::NO_SYNCHRONIZATION;
+    _posSRz->Flags.BehaviorAfterFinalStateOfMotionIsReached = RMLPositionFlags::RECOMPUTE_TRAJECTORY;
+    _posXY = std::make_unique<SpgPositionObjects>(2, dt); // X, Y
+    _posXY->Flags.SynchronizationBehavior = RMLPositionFlags::PHASE_SYNCHRONIZATION_IF_POSSIBLE;
+    _posXY->Flags.BehaviorAfterFinalStateOfMotionIsReached = RMLPositionFlags::RECOMPUTE_TRAJECTORY;
+    _posRz = std::make_unique<SpgPositionObjects>(1, dt); // Rz
+    _posRz->Flags.SynchronizationBehavior = RMLPositionFlags::NO_SYNCHRONIZATION;
+    _posRz->Flags.BehaviorAfterFinalStateOfMotionIsReached = RMLPositionFlags::RECOMPUTE_TRAJECTORY;
+    _velXYRz = std::make_unique<SpgVelocityObjects>(3, dt); // X, Y, Rz
+    _velXYRz->Flags.SynchronizationBehavior = RMLVelocityFlags::PHASE_SYNCHRONIZATION_IF_POSSIBLE;
+}
+
 bool SPGVelocitySetpointController::calculate(VelocityControlData &data)
 {
     // Type II Reflexxes Motion Library
     // note that this variant does not support jerk control
 
-    // in order to achieve higher deceleration, a layer is added around the SPG algorithm
-    // we start with (aggressive) deceleration limits, so the robot is normally going to be in time for braking
-    // and we get a good estimate of velocity and acceleration setpoint
-    // then, if robot _seems_ to be accelerating, corresponding limits are used in a recalculation
-    SpgLimits spgLimits;
-    spgLimits.vx = data.limits.maxvel().x();
-    spgLimits.vy = data.limits.maxvel().yforward();
-    spgLimits.vRz = data.limits.maxvel().rz();
-    spgLimits.ax = data.limits.maxdec().x();
-    spgLimits.ay = data.limits.maxdec().y();
-    spgLimits.aRz = data.limits.maxdec().rz();
-
     // For position, finding a weighted average on the Rz is not trivial when the angles are around the boundary of [0, 2pi].
     // To solve this, rotate both currentPosFCS.Rz and previousPosSetpointFCS.Rz towards currentPosFCS.Rz.
     // This means currentPosFCS.Rz = 0, and previousPosSetpointFCS.Rz is the difference to currentPosFCS.Rz.
@@ -58,61 +70,48 @@ bool SPGVelocitySetpointController::calculate(VelocityControlData &data)
     _targetVelocityRCS = Velocity2D(data.targetVelocityFcs).transformFcsToRcs(weightedCurrentPositionFCS);
 
 
+    prepareObjects(data.config.dt());
+
+    // in order to achieve higher deceleration, a layer is added around the SPG algorithm
+    // we start with (aggressive) deceleration limits, so the robot is normally going to be in time for braking
+    // and we get a good estimate of velocity and acceleration setpoint
+    // then, if robot _seems_ to be accelerating, corresponding limits are used in a recalculation
+    SpgLimits decelerationLimits;
+    decelerationLimits.vx = data.limits.maxVel.x;
+    decelerationLimits.vy = data.limits.maxVel.yforward;
+    decelerationLimits.vRz = data.limits.maxVel.rz;
+    decelerationLimits.ax = data.limits.maxDec.x;
+    decelerationLimits.ay = data.limits.maxDec.y;
+    decelerationLimits.aRz = data.limits.maxDec.rz;
+
     Position2D resultPosition;
     Velocity2D resultVelocity;
-    bool result = calculateSPG(data, spgLimits, resultPosition, resultVelocity);
-
-    bool recalculate = false;
-    if (isDofAccelerating(data, resultVelocity, 0, data.limits.accthreshold().x()))
-    {
-        recalculate = true;
-        spgLimits.ax = data.limits.maxacc().x();
-    }
-    if (isDofAccelerating(data, resultVelocity, 1, data.limits.accthreshold().y()))
-    {
-        recalculate = true;
-        spgLimits.ay = (resultVelocity.y < 0.0) ? data.limits.maxacc().ybackward() : data.limits.maxacc().yforward();
-    }
-    if (isDofAccelerating(data, resultVelocity, 2, data.limits.accthreshold().rz()))
+    SpgLimits spgLimits = decelerationLimits;
+    if (data.config.spg().predictlimits())
     {
-        recalculate = true;
-        spgLimits.aRz = data.limits.maxacc().rz();
+        // instead, start from a cheap kinematic guess of the limits, so typically the recalculation is not needed
+        // (when the guess is wrong, the recalculation uses the limits selected by the first calculation, as above)
+        spgLimits = selectLimits(data, decelerationLimits, predictVelocity(data, decelerationLimits));
     }
-    if (resultVelocity.y < 0.0)
-    {
-        recalculate = true;
-        spgLimits.vy = data.limits.maxvel().ybackward();
-    }
-
+    bool result = calculateSPG(data, spgLimits, resultPosition, resultVelocity);
 
-    // recalculate?
-    if (recalculate)
+    // recalculate? (only needed when other limits apply)
+    SpgLimits selectedLimits = selectLimits(data, decelerationLimits, resultVelocity);
+    if (selectedLimits != spgLimits)
     {
-        result = calculateSPG(data, spgLimits, resultPosition, resultVelocity);
+        result = calculateSPG(data, selectedLimits, resultPosition, resultVelocity);
     }
 
 
-    // check if motor limits are not exceeded.
-    /* disabled - in MRA context, we must not depend on vtClient
-    for(int i = 0; i < 10; i++)
-    {
-        if (data.vtClient.exceedsMotorLimits( pose(resultVelocity.x, resultVelocity.y, resultVelocity.rz) ))
-        {
-            // reduce limits by 20% to see if we can find setpoints which do not exceed the motor limits
-            spgLimits.vx *= 0.8;
-            spgLimits.vy *= 0.8;
-            spgLimits.vRz *= 0.8;
-            result = calculateSPG(data, spgLimits, resultPosition, resultVelocity);
-        }
-        else
-        {
-            break;
-        }
-    }
-    */
+    // motor limits are not checked here (used to be an iterative reduction of the limits and recalculation)
+    // instead, if configured, the velocity limits are made feasible for all wheels upfront, see ConfigureLimits
 
     // Done -- store output and values for next iteration
     data.resultVelocityRcs = resultVelocity;
+    if (result && data.config.trajectory().enabled())
+    {
+        describeTrajectory(data);
+    }
 
     // Store previousPositionSetpointFcs for open loop control
     Position2D tmpPos = resultPosition;
@@ -127,59 +126,220 @@ bool SPGVelocitySetpointController::calculate(VelocityControlData &data)
     return result;
 }
 
-bool SPGVelocitySetpointController::isDofAccelerating(const VelocityControlData &data, const Velocity2D& resultVelocity, int dof, float threshold)
+SpgLimits SPGVelocitySetpointController::selectLimits(const VelocityControlData &data, SpgLimits const &decelerationLimits, const Velocity2D& resultVelocity)
 {
-    // To check if a DOF is accelerating, we should look if the _currentVelocityRCS -> resultVelocity is "moving away from zero".
-
-    std::vector<double> currentVelocity;
-    currentVelocity.push_back(_currentVelocityRCS.x);
-    currentVelocity.push_back(_currentVelocityRCS.y);
-    currentVelocity.push_back(_currentVelocityRCS.rz);
-
-    std::vector<double> newVelocity;
-    newVelocity.push_back(resultVelocity.x);
-    newVelocity.push_back(resultVelocity.y);
-    newVelocity.push_back(resultVelocity.rz);
+    SpgLimits result = decelerationLimits;
+    if (isDofAccelerating(_currentVelocityRCS.x, resultVelocity.x, data.limits.accThreshold.x))
+    {
+        result.ax = data.limits.maxAcc.x;
+    }
+    if (isDofAccelerating(_currentVelocityRCS.y, resultVelocity.y, data.limits.accThreshold.y))
+    {
+        result.ay = (resultVelocity.y < 0.0) ? data.limits.maxAcc.ybackward : data.limits.maxAcc.yforward;
+    }
+    if (isDofAccelerating(_currentVelocityRCS.rz, resultVelocity.rz, data.limits.accThreshold.rz))
+    {
+        result.aRz = data.limits.maxAcc.rz;
+    }
+    if (resultVelocity.y < 0.0)
+    {
+        result.vy = data.limits.maxVel.ybackward;
+    }
+    return result;
+}
 
+bool SPGVelocitySetpointController::isDofAccelerating(double currentVelocity, double newVelocity, float threshold)
+{
+    // To check if a DOF is accelerating, we should look if the _currentVelocityRCS -> resultVelocity is "moving away from zero".
 
-    if (currentVelocity.at(dof) < 0.0)
+    if (currentVelocity < 0.0)
     {
         // newVelocity - currentVelocity < threshold
         // e.g., -2.0 - -1.0 = -1.0 < (-threshold)
-        return (newVelocity.at(dof) - currentVelocity.at(dof)) < (-threshold);
+        return (newVelocity - currentVelocity) < (-threshold);
     }
-    else if (currentVelocity.at(dof) > 0.0)
+    else if (currentVelocity > 0.0)
     {
         // newVelocity - currentVelocity > threshold
         // e.g., 2.0 - 1.0 = 1.0 > threshold
-        return (newVelocity.at(dof) - currentVelocity.at(dof)) > threshold;
+        return (newVelocity - currentVelocity) > threshold;
     }
     else
     {
         // currentVelocity == 0.0
-        return abs(newVelocity.at(dof)) > threshold;
+        return abs(newVelocity) > threshold;
     }
 
     return true;
 }
 
+void SPGVelocitySetpointController::sampleLastSolve(double t, Velocity2D &velocity, Velocity2D &acceleration)
+{
+    // evaluate the trajectory of the last Reflexxes calculation at given time (as used for the latency correction)
+    switch (_lastSolve)
+    {
+        case LastSolve::POS_XYRZ:
+        {
+            RMLPositionOutputParameters *OP = &_posXYRz->OP;
+            _posXYRz->RML.RMLPositionAtAGivenSampleTime(t, OP);
+            velocity = Velocity2D(OP->NewVelocityVector->VecData[0], OP->NewVelocityVector->VecData[1], 0.0, 0.0, 0.0, OP->NewVelocityVector->VecData[2]);
+            acceleration = Velocity2D(OP->NewAccelerationVector->VecData[0], OP->NewAccelerationVector->VecData[1], 0.0, 0.0, 0.0, OP->NewAccelerationVector->VecData[2]);
+            break;
+        }
+        case LastSolve::POS_XY_AND_RZ:
+        {
+            RMLPositionOutputParameters *OPXY = &_posXY->OP;
+            RMLPositionOutputParameters *OPRz = &_posRz->OP;
+            _posXY->RML.RMLPositionAtAGivenSampleTime(t, OPXY);
+            _posRz->RML.RMLPositionAtAGivenSampleTime(t, OPRz);
+            velocity = Velocity2D(OPXY->NewVelocityVector->VecData[0], OPXY->NewVelocityVector->VecData[1], 0.0, 0.0, 0.0, OPRz->NewVelocityVector->VecData[0]);
+            acceleration = Velocity2D(OPXY->NewAccelerationVector->VecData[0], OPXY->NewAccelerationVector->VecData[1], 0.0, 0.0, 0.0, OPRz->NewAccelerationVector->VecData[0]);
+            break;
+        }
+        case LastSolve::POS_SRZ:
+        {
+            RMLPositionOutputParameters *OP = &_posSRz->OP;
+            _posSRz->RML.RMLPositionAtAGivenSampleTime(t, OP);
+            double v = OP->NewVelocityVector->VecData[0];
+            double a = OP->NewAccelerationVector->VecData[0];
+            velocity = Velocity2D(v * _directionXY.x, v * _directionXY.y, 0.0, 0.0, 0.0, OP->NewVelocityVector->VecData[1]);
+            acceleration = Velocity2D(a * _directionXY.x, a * _directionXY.y, 0.0, 0.0, 0.0, OP->NewAccelerationVector->VecData[1]);
+            break;
+        }
+        case LastSolve::VEL_XYRZ:
+        {
+            RMLVelocityOutputParameters *OP = &_velXYRz->OP;
+            _velXYRz->RML.RMLVelocityAtAGivenSampleTime(t, OP);
+            velocity = Velocity2D(OP->NewVelocityVector->VecData[0], OP->NewVelocityVector->VecData[1], 0.0, 0.0, 0.0, OP->NewVelocityVector->VecData[2]);
+            acceleration = Velocity2D(OP->NewAccelerationVector->VecData[0], OP->NewAccelerationVector->VecData[1], 0.0, 0.0, 0.0, OP->NewAccelerationVector->VecData[2]);
+            break;
+        }
+        default:
+            break;
+    }
+}
+
+bool SPGVelocitySetpointController::describeSegments(VelocityTrajectory &trajectory, double ta, Velocity2D const &va, double tb, Velocity2D const &vb, int depth)
+{
+    // the interval is a single segment if the velocity is linear: at the midpoint it should be the average and have the right slope
+    double duration = tb - ta;
+    double tm = 0.5 * (ta + tb);
+    Velocity2D vm;
+    Velocity2D am;
+    sampleLastSolve(tm, vm, am);
+    auto isLinear = [duration](double a, double b, double m, double slope)
+    {
+        double const tolerance = 1e-9;
+        return (fabs(m - 0.5 * (a + b)) < tolerance) && (fabs(b - a - slope * duration) < tolerance);
+    };
+    bool linear = isLinear(va.x, vb.x, vm.x, am.x) && isLinear(va.y, vb.y, vm.y, am.y) && isLinear(va.rz, vb.rz, vm.rz, am.rz);
+    if (linear)
+    {
+        return trajectory.add(duration, va, (vb - va) / duration);
+    }
+    if (depth >= 20)
+    {
+        // an acceleration switch, localized well enough (depth 20 means below 1e-6 of the horizon):
+        // extend the previous segment, the next one starts at the exact velocity again
+        Velocity2D acceleration = (trajectory.numSegments > 0) ? trajectory.segments[trajectory.numSegments - 1].acceleration : Velocity2D((vb - va) / duration);
+        return trajectory.add(duration, va, acceleration);
+    }
+    return describeSegments(trajectory, ta, va, tm, vm, depth + 1) && describeSegments(trajectory, tm, vm, tb, vb, depth + 1);
+}
+
+void SPGVelocitySetpointController::describeTrajectory(VelocityControlData &data)
+{
+    // Reflexxes does not expose the polynomials of its trajectory, but they can be recovered by sampling:
+    // in the TypeII library acceleration is piecewise constant, so velocity is piecewise linear
+    // intervals are bisected until they are linear, only around the acceleration switches
+    // the trajectory starts at the velocity output (including latency correction) and covers the configured horizon
+    // (or less, when running out of segments)
+    data.resultTrajectoryRcs.reset();
+    if (_lastSolve == LastSolve::NONE)
+    {
+        return; // for instance velocity already reached: constant
+    }
+    double t0 = data.config.dt() + data.config.spg().latencyoffset();
+    double t1 = t0 + std::max(data.config.trajectory().horizon(), data.config.dt());
+    Velocity2D v0, v1, acceleration;
+    sampleLastSolve(t0, v0, acceleration);
+    sampleLastSolve(t1, v1, acceleration);
+    describeSegments(data.resultTrajectoryRcs, t0, v0, t1, v1, 0);
+}
+
+static double predictDofVelocity(double delta, double currentVelocity, double targetVelocity, double maxVelocity, double maxAcceleration, double t, bool velocityOnly)
+{
+    // velocity towards which the first phase of the trajectory steers
+    double steerVelocity = std::clamp(targetVelocity, -maxVelocity, maxVelocity);
+    if (!velocityOnly && delta != 0.0)
+    {
+        // keep going towards the target position, until the distance needed to brake to target velocity is reached
+        double brakingDistance = (currentVelocity * currentVelocity - steerVelocity * steerVelocity) / (2.0 * maxAcceleration);
+        bool braking = (currentVelocity * delta > 0.0) && (brakingDistance >= fabs(delta));
+        if (!braking)
+        {
+            // accelerate up to the peak velocity (capped at the maximum), then brake to the target velocity
+            double peakVelocity = std::copysign(std::min(maxVelocity, sqrt(maxAcceleration * fabs(delta) + 0.5 * (currentVelocity * currentVelocity + steerVelocity * steerVelocity))), delta);
+            double peakTime = fabs(peakVelocity - currentVelocity) / maxAcceleration;
+            if (fabs(peakVelocity) < maxVelocity && peakTime < t)
+            {
+                // short move, already braking (or even arrived) at time t
+                double brakeVelocity = peakVelocity - std::copysign(maxAcceleration * (t - peakTime), delta);
+                return (delta > 0.0) ? std::max(brakeVelocity, steerVelocity) : std::min(brakeVelocity, steerVelocity);
+            }
+            steerVelocity = peakVelocity;
+        }
+    }
+    return currentVelocity + std::clamp(steerVelocity - currentVelocity, -maxAcceleration * t, maxAcceleration * t);
+}
+
+Velocity2D SPGVelocitySetpointController::predictVelocity(const VelocityControlData &data, SpgLimits const &spgLimits)
+{
+    // treat each DOF independently (ignoring synchronization) as a bang-bang profile, evaluated at the same time as the SPG output
+    double t = data.config.dt() + data.config.spg().latencyoffset();
+    bool velocityOnly = (data.controlMode == MRA::FalconsVelocityControl::ControlModeEnum::VEL_ONLY);
+    Velocity2D result;
+    result.x = predictDofVelocity(_deltaPositionRCS.x, _currentVelocityRCS.x, _targetVelocityRCS.x, spgLimits.vx, spgLimits.ax, t, velocityOnly);
+    result.y = predictDofVelocity(_deltaPositionRCS.y, _currentVelocityRCS.y, _targetVelocityRCS.y, spgLimits.vy, spgLimits.ay, t, velocityOnly);
+    result.rz = predictDofVelocity(_deltaPositionRCS.rz, _currentVelocityRCS.rz, _targetVelocityRCS.rz, spgLimits.vRz, spgLimits.aRz, t, velocityOnly);
+    return result;
+}
+
 
 
 
 bool SPGVelocitySetpointController::calculateSPG(VelocityControlData& data, SpgLimits const &spgLimits, Position2D& resultPosition, Velocity2D &resultVelocity)
 {
     bool result = false;
+    double maxVelocity = 0.0;
+    double maxAcceleration = 0.0;
+    _lastSolve = LastSolve::NONE;
+    if (data.profiling.spgCalculations++ > 0)
+    {
+        data.profiling.spgRecalculations++;
+    }
     if (data.controlMode != MRA::FalconsVelocityControl::ControlModeEnum::VEL_ONLY)
     {
         // POS_ONLY or POSVEL
         if (data.config.spg().synchronizerotation())
         {
-            result = calculatePosXYRzPhaseSynchronized(data, spgLimits, resultPosition, resultVelocity);
+            result = calculatePosXYRz(data, *_posXYRz, spgLimits, resultPosition, resultVelocity);
+            _lastSolve = LastSolve::POS_XYRZ;
+        }
+        else if (fuseCollinearXY && reduceCollinearXY(spgLimits, _directionXY, maxVelocity, maxAcceleration))
+        {
+            // Reflexxes can only synchronize either all DOFs or none, so XY phase synchronized with Rz independent takes two calls,
+            // but a phase synchronized XY trajectory is a straight line: when the XY problem is collinear it is a single DOF,
+            // which is solved together with Rz without synchronization
+            result = calculatePosXYCollinearRzNonSynchronized(data, spgLimits, _directionXY, maxVelocity, maxAcceleration, resultPosition, resultVelocity);
+            _lastSolve = LastSolve::POS_SRZ;
         }
         else
         {
-            result = calculatePosXYPhaseSynchronized(data, spgLimits, resultPosition, resultVelocity);
-            result = calculatePosRzNonSynchronized(data, spgLimits, resultPosition, resultVelocity);
+            bool resultXY = calculatePosXYPhaseSynchronized(data, spgLimits, resultPosition, resultVelocity);
+            bool resultRz = calculatePosRzNonSynchronized(data, spgLimits, resultPosition, resultVelocity);
+            result = resultXY && resultRz;
+            _lastSolve = LastSolve::POS_XY_AND_RZ;
         }
     }
     else
@@ -201,22 +361,75 @@ bool SPGVelocitySetpointController::calculateSPG(VelocityControlData& data, SpgL
     return result;
 }
 
-bool SPGVelocitySetpointController::calculatePosXYRzPhaseSynchronized(VelocityControlData& data, const SpgLimits& spgLimits, Position2D& resultPosition, Velocity2D &resultVelocity)
+void SPGVelocitySetpointController::countSolve(VelocityControlData &data, int resultValue)
+{
+    data.profiling.spgSolves++;
+    if (resultValue == ReflexxesAPI::RML_FINAL_STATE_REACHED)
+    {
+        data.profiling.spgFinalStateReached++;
+    }
+    else if (resultValue < 0)
+    {
+        data.profiling.spgErrors++;
+    }
+}
+
+bool SPGVelocitySetpointController::reduceCollinearXY(SpgLimits const &spgLimits, MRA::Geometry::Point &direction, double &maxVelocity, double &maxAcceleration)
 {
+    // the XY problem reduces to a single DOF when delta position, current velocity and target velocity are collinear
+    // Reflexxes then phase synchronizes XY: the DOF with the longest execution time follows its own time-optimal profile,
+    // the other one is a scaled copy, so the trajectory is the time-optimal one along the direction with the limits of that DOF,
+    // projected onto the direction (which is the most restrictive projection, if it is for both velocity and acceleration)
+    // when the most restrictive DOF differs for velocity and acceleration, Reflexxes cannot phase synchronize: not reduced
+    // the tolerance is tight, so the result equals the phase synchronized one up to rounding
+    // (Reflexxes also rejects phase synchronization of some collinear problems, on its profile checks of the scaled DOF,
+    // and then time synchronizes XY, leaving the line; the reduced problem stays on the line)
+    double const tolerance = 1e-9;
+    MRA::Geometry::Point vectors[3] = {
+        MRA::Geometry::Point(_deltaPositionRCS.x, _deltaPositionRCS.y),
+        MRA::Geometry::Point(_currentVelocityRCS.x, _currentVelocityRCS.y),
+        MRA::Geometry::Point(_targetVelocityRCS.x, _targetVelocityRCS.y)
+    };
+    direction = MRA::Geometry::Point(1.0, 0.0); // when not moving at all: any direction
+    double length = 0.0;
+    for (auto const &v: vectors)
+    {
+        if (v.size() > length)
+        {
+            length = v.size();
+            direction = v / length;
+        }
+    }
+    for (auto const &v: vectors)
+    {
+        if (fabs(v.x * direction.y - v.y * direction.x) > tolerance * (1.0 + v.size()))
+        {
+            return false;
+        }
+    }
+    double const infinity = std::numeric_limits<double>::infinity();
+    double ratioVelocityX = (direction.x != 0.0) ? spgLimits.vx / fabs(direction.x) : infinity;
+    double ratioVelocityY = (direction.y != 0.0) ? spgLimits.vy / fabs(direction.y) : infinity;
+    double ratioAccelerationX = (direction.x != 0.0) ? spgLimits.ax / fabs(direction.x) : infinity;
+    double ratioAccelerationY = (direction.y != 0.0) ? spgLimits.ay / fabs(direction.y) : infinity;
+    if ((ratioVelocityX < ratioVelocityY) != (ratioAccelerationX < ratioAccelerationY)
+        && ratioVelocityX != ratioVelocityY && ratioAccelerationX != ratioAccelerationY)
+    {
+        return false;
+    }
+    maxVelocity = std::min(ratioVelocityX, ratioVelocityY);
+    maxAcceleration = std::min(ratioAccelerationX, ratioAccelerationY);
+    return true;
+}
 
-    // initialize
-    ReflexxesAPI                *RML = NULL;
-    RMLPositionInputParameters  *IP = NULL;
-    RMLPositionOutputParameters *OP = NULL;
-    RMLPositionFlags            Flags;
-    Flags.SynchronizationBehavior                  = RMLPositionFlags::PHASE_SYNCHRONIZATION_IF_POSSIBLE;
-    Flags.BehaviorAfterFinalStateOfMotionIsReached = RMLPositionFlags::RECOMPUTE_TRAJECTORY;
+bool SPGVelocitySetpointController::calculatePosXYRz(VelocityControlData& data, SpgPositionObjects &objects, const SpgLimits& spgLimits, Position2D& resultPosition, Velocity2D &resultVelocity)
+{
 
-    // construct Reflexxes objects
-    int numberOfDOFs = 3; //X, Y, Rz
-    RML = new ReflexxesAPI(numberOfDOFs, data.config.dt()); // degrees of freedom (x,y,Rz), nominal cycle time
-    IP  = new RMLPositionInputParameters(numberOfDOFs);
-    OP  = new RMLPositionOutputParameters(numberOfDOFs);
+    // reuse preallocated Reflexxes objects, their flags determine the synchronization
+    ReflexxesAPI                *RML = &objects.RML;
+    RMLPositionInputParameters  *IP = &objects.IP;
+    RMLPositionOutputParameters *OP = &objects.OP;
+    RMLPositionFlags const      &Flags = objects.nextFlags();
 
     // set-up the input parameters
     IP->CurrentPositionVector->VecData      [0] = 0.0; // instead of steering from current to target,
@@ -257,6 +470,7 @@ bool SPGVelocitySetpointController::calculatePosXYRzPhaseSynchronized(VelocityCo
 
     // call the Reflexxes Online Trajectory Generation algorithm
     int r1 = RML->RMLPosition(*IP, OP, Flags);
+    countSolve(data, r1);
     if (r1 < 0)
     {
         // error state
@@ -312,30 +526,18 @@ bool SPGVelocitySetpointController::calculatePosXYRzPhaseSynchronized(VelocityCo
     data.spgNewVelocity.Rz = OP->NewVelocityVector->VecData[2];
     */
 
-    // cleanup
-    delete RML;
-    delete IP;
-    delete OP;
-
     return true;
 }
 
 bool SPGVelocitySetpointController::calculatePosXYPhaseSynchronized(VelocityControlData& data, SpgLimits const &spgLimits, Position2D& resultPosition, Velocity2D &resultVelocity)
 {
 
-    // initialize
-    ReflexxesAPI                *RML = NULL;
-    RMLPositionInputParameters  *IP = NULL;
-    RMLPositionOutputParameters *OP = NULL;
-    RMLPositionFlags            Flags;
-    Flags.SynchronizationBehavior                  = RMLPositionFlags::PHASE_SYNCHRONIZATION_IF_POSSIBLE;
-    Flags.BehaviorAfterFinalStateOfMotionIsReached = RMLPositionFlags::RECOMPUTE_TRAJECTORY;
-
-    // construct Reflexxes objects
-    int numberOfDOFs = 2; //X, Y
-    RML = new ReflexxesAPI(numberOfDOFs, data.config.dt()); // degrees of freedom (x,y), nominal cycle time
-    IP  = new RMLPositionInputParameters(numberOfDOFs);
-    OP  = new RMLPositionOutputParameters(numberOfDOFs);
+    // reuse preallocated Reflexxes objects
+    SpgPositionObjects &objects = *_posXY;
+    ReflexxesAPI                *RML = &objects.RML;
+    RMLPositionInputParameters  *IP = &objects.IP;
+    RMLPositionOutputParameters *OP = &objects.OP;
+    RMLPositionFlags const      &Flags = objects.nextFlags();
 
     // set-up the input parameters
     IP->CurrentPositionVector->VecData      [0] = 0.0; // instead of steering from current to target,
@@ -367,6 +569,7 @@ bool SPGVelocitySetpointController::calculatePosXYPhaseSynchronized(VelocityCont
 
     // call the Reflexxes Online Trajectory Generation algorithm
     int r1 = RML->RMLPosition(*IP, OP, Flags);
+    countSolve(data, r1);
     if (r1 < 0)
     {
         // error state
@@ -412,11 +615,6 @@ bool SPGVelocitySetpointController::calculatePosXYPhaseSynchronized(VelocityCont
     data.spgNewVelocity.y  = OP->NewVelocityVector->VecData[1];
     */
 
-    // cleanup
-    delete RML;
-    delete IP;
-    delete OP;
-
     return true;
 }
 
@@ -424,19 +622,12 @@ bool SPGVelocitySetpointController::calculatePosXYPhaseSynchronized(VelocityCont
 bool SPGVelocitySetpointController::calculatePosRzNonSynchronized(VelocityControlData& data, SpgLimits const &spgLimits, Position2D& resultPosition, Velocity2D &resultVelocity)
 {
 
-    // initialize
-    ReflexxesAPI                *RML = NULL;
-    RMLPositionInputParameters  *IP = NULL;
-    RMLPositionOutputParameters *OP = NULL;
-    RMLPositionFlags            Flags;
-    Flags.SynchronizationBehavior                  = RMLPositionFlags::NO_SYNCHRONIZATION;
-    Flags.BehaviorAfterFinalStateOfMotionIsReached = RMLPositionFlags::RECOMPUTE_TRAJECTORY;
-
-    // construct Reflexxes objects
-    int numberOfDOFs = 1; // Rz
-    RML = new ReflexxesAPI(numberOfDOFs, data.config.dt()); // degrees of freedom (Rz), nominal cycle time
-    IP  = new RMLPositionInputParameters(numberOfDOFs);
-    OP  = new RMLPositionOutputParameters(numberOfDOFs);
+    // reuse preallocated Reflexxes objects
+    SpgPositionObjects &objects = *_posRz;
+    ReflexxesAPI                *RML = &objects.RML;
+    RMLPositionInputParameters  *IP = &objects.IP;
+    RMLPositionOutputParameters *OP = &objects.OP;
+    RMLPositionFlags const      &Flags = objects.nextFlags();
 
     // set-up the input parameters
     IP->CurrentPositionVector->VecData      [0] = 0.0; // controlling FCS or RCS
@@ -451,6 +642,7 @@ bool SPGVelocitySetpointController::calculatePosRzNonSynchronized(VelocityContro
 
     // call the Reflexxes Online Trajectory Generation algorithm
     int r1 = RML->RMLPosition(*IP, OP, Flags);
+    countSolve(data, r1);
     if (r1 < 0)
     {
         // error state
@@ -478,31 +670,84 @@ bool SPGVelocitySetpointController::calculatePosRzNonSynchronized(VelocityContro
     data.spgNewVelocity.Rz = OP->NewVelocityVector->VecData[0];
     */
 
-    // cleanup
-    delete RML;
-    delete IP;
-    delete OP;
-
     return true;
 }
 
 
 
-bool SPGVelocitySetpointController::calculateVelXYRzPhaseSynchronized(VelocityControlData& data, SpgLimits const &spgLimits, Position2D& resultPosition, Velocity2D &resultVelocity)
+bool SPGVelocitySetpointController::calculatePosXYCollinearRzNonSynchronized(VelocityControlData& data, SpgLimits const &spgLimits, MRA::Geometry::Point const &direction, double maxVelocity, double maxAcceleration, Position2D& resultPosition, Velocity2D &resultVelocity)
 {
 
-    // initialize
-    ReflexxesAPI                *RML = NULL;
-    RMLVelocityInputParameters  *IP = NULL;
-    RMLVelocityOutputParameters *OP = NULL;
-    RMLVelocityFlags            Flags;
-    Flags.SynchronizationBehavior = RMLVelocityFlags::PHASE_SYNCHRONIZATION_IF_POSSIBLE;
+    // reuse preallocated Reflexxes objects
+    SpgPositionObjects &objects = *_posSRz;
+    ReflexxesAPI                *RML = &objects.RML;
+    RMLPositionInputParameters  *IP = &objects.IP;
+    RMLPositionOutputParameters *OP = &objects.OP;
+    RMLPositionFlags const      &Flags = objects.nextFlags();
+
+    // set-up the input parameters: XY projected onto the direction, Rz as usual
+    IP->CurrentPositionVector->VecData      [0] = 0.0; // instead of steering from current to target,
+    IP->CurrentPositionVector->VecData      [1] = 0.0; // we steer from zero to delta
+
+    IP->CurrentVelocityVector->VecData      [0] = _currentVelocityRCS.x * direction.x + _currentVelocityRCS.y * direction.y;
+    IP->CurrentVelocityVector->VecData      [1] = _currentVelocityRCS.rz;
+
+    IP->CurrentAccelerationVector->VecData  [0] = 0.0; // not relevant, due to limitation of TypeII library
+    IP->CurrentAccelerationVector->VecData  [1] = 0.0;
+
+    IP->MaxVelocityVector->VecData          [0] = maxVelocity;
+    IP->MaxVelocityVector->VecData          [1] = spgLimits.vRz;
+
+    IP->MaxAccelerationVector->VecData      [0] = maxAcceleration;
+    IP->MaxAccelerationVector->VecData      [1] = spgLimits.aRz;
+
+    IP->MaxJerkVector->VecData              [0] = 0.0; // not used in TypeII library
+    IP->MaxJerkVector->VecData              [1] = 0.0;
+
+    IP->TargetPositionVector->VecData       [0] = _deltaPositionRCS.x * direction.x + _deltaPositionRCS.y * direction.y;
+    IP->TargetPositionVector->VecData       [1] = _deltaPositionRCS.rz;
+
+    IP->TargetVelocityVector->VecData       [0] = _targetVelocityRCS.x * direction.x + _targetVelocityRCS.y * direction.y;
+    IP->TargetVelocityVector->VecData       [1] = _targetVelocityRCS.rz;
+
+    IP->SelectionVector->VecData            [0] = true;
+    IP->SelectionVector->VecData            [1] = true;
+
+    // call the Reflexxes Online Trajectory Generation algorithm
+    int r1 = RML->RMLPosition(*IP, OP, Flags);
+    countSolve(data, r1);
+    if (r1 < 0)
+    {
+        // error state
+        return false;
+    }
+
+    // output parameters have been evaluated at first tick (data.config.dt())
+    // latency correction: evaluate the trajectory at some offset
+    double timeOffset = data.config.dt() + data.config.spg().latencyoffset();
+    RML->RMLPositionAtAGivenSampleTime(timeOffset, OP);
 
-    // construct Reflexxes objects
-    int numberOfDOFs = 3; //X, Y, Rz
-    RML = new ReflexxesAPI(numberOfDOFs, data.config.dt()); // degrees of freedom (x,y,Rz), nominal cycle time
-    IP  = new RMLVelocityInputParameters(numberOfDOFs);
-    OP = new RMLVelocityOutputParameters(numberOfDOFs);
+    // convert outputs
+    resultPosition.x  = OP->NewPositionVector->VecData[0] * direction.x;
+    resultPosition.y  = OP->NewPositionVector->VecData[0] * direction.y;
+    resultPosition.rz = OP->NewPositionVector->VecData[1];
+
+    resultVelocity.x  = OP->NewVelocityVector->VecData[0] * direction.x;
+    resultVelocity.y  = OP->NewVelocityVector->VecData[0] * direction.y;
+    resultVelocity.rz = OP->NewVelocityVector->VecData[1];
+
+    return true;
+}
+
+bool SPGVelocitySetpointController::calculateVelXYRzPhaseSynchronized(VelocityControlData& data, SpgLimits const &spgLimits, Position2D& resultPosition, Velocity2D &resultVelocity)
+{
+
+    // reuse preallocated Reflexxes objects
+    SpgVelocityObjects &objects = *_velXYRz;
+    ReflexxesAPI                *RML = &objects.RML;
+    RMLVelocityInputParameters  *IP = &objects.IP;
+    RMLVelocityOutputParameters *OP = &objects.OP;
+    RMLVelocityFlags const      &Flags = objects.nextFlags();
 
     // set-up the input parameters
     IP->CurrentPositionVector->VecData      [0] = 0.0; // instead of steering from current to target,
@@ -535,6 +780,7 @@ bool SPGVelocitySetpointController::calculateVelXYRzPhaseSynchronized(VelocityCo
 
     // call the Reflexxes Online Trajectory Generation algorithm
     int r1 = RML->RMLVelocity(*IP, OP, Flags);
+    countSolve(data, r1);
     if (r1 < 0)
     {
         // error state
@@ -578,6 +824,7 @@ bool SPGVelocitySetpointController::calculateVelXYRzPhaseSynchronized(VelocityCo
             resultVelocity.x = OP->NewVelocityVector->VecData[0];
             resultVelocity.y = OP->NewVelocityVector->VecData[1];
             resultVelocity.rz = OP->NewVelocityVector->VecData[2];
+            _lastSolve = LastSolve::VEL_XYRZ;
         }
     }
 
@@ -608,11 +855,6 @@ bool SPGVelocitySetpointController::calculateVelXYRzPhaseSynchronized(VelocityCo
     data.spgNewVelocity.Rz = OP->NewVelocityVector->VecData[2];
     */
 
-    // cleanup
-    delete RML;
-    delete IP;
-    delete OP;
-
     return true;
 }
 
@@ -10,6 +10,10 @@ using namespace ::testing;
 
 // System under test:
 #include "FalconsVelocityControl.hpp"
+#include "VelocityTrajectory.hpp"
+#include "VelocityControlBatch.hpp"
+#include "VelocitySetpointControllers.hpp"
+#include <random>
 using namespace MRA;
 
 // Basic tick shall run OK and return error_value 0.
@@ -144,6 +148,158 @@ TEST(FalconsVelocityControlTest, moveRz)
     EXPECT_FLOAT_EQ(output.velocity().rz(), acc * dt);
 }
 
+// Without synchronizeRotation, Rz shall accelerate independently of XY.
+TEST(FalconsVelocityControlTest, moveXRzNonSynchronized)
+{
+    // Arrange
+    auto m = FalconsVelocityControl::FalconsVelocityControl();
+    auto input = FalconsVelocityControl::Input();
+    auto output = FalconsVelocityControl::Output();
+    input.mutable_worldstate()->mutable_robot()->mutable_position()->set_x(1.0);
+    input.mutable_worldstate()->mutable_robot()->mutable_velocity()->set_x(0.0);
+    input.mutable_setpoint()->mutable_position()->set_x(4.0);
+    input.mutable_setpoint()->mutable_position()->set_rz(0.5);
+    input.mutable_worldstate()->mutable_robot()->set_active(true);
+    auto params = m.defaultParams();
+    params.mutable_spg()->set_synchronizerotation(false);
+    float accX = 1.5;
+    float accRz = 1.7;
+    params.mutable_limits(0)->mutable_maxacc()->set_x(accX);
+    params.mutable_limits(0)->mutable_maxacc()->set_rz(accRz);
+    float dt = 1.0 / 40;
+    params.set_dt(dt);
+
+    // Act
+    int error_value = m.tick(input, params, output);
+
+    // Assert
+    EXPECT_EQ(error_value, 0);
+    EXPECT_FLOAT_EQ(output.velocity().x(), accX * dt);
+    EXPECT_FLOAT_EQ(output.velocity().y(), 0.0);
+    EXPECT_FLOAT_EQ(output.velocity().rz(), accRz * dt);
+}
+
+// Without synchronizeRotation and with collinear XY, XY and Rz shall be solved in a single Reflexxes call,
+// with the same result as phase synchronizing XY in a separate call.
+TEST(FalconsVelocityControlTest, fusedCollinearXYRz)
+{
+    // Arrange
+    auto m = FalconsVelocityControl::FalconsVelocityControl();
+    auto params = m.defaultParams();
+    ASSERT_FALSE(params.spg().synchronizerotation());
+    params.set_profiling(true);
+    params.mutable_spg()->set_weightfactorclosedlooppos(1.0);
+    params.mutable_spg()->set_weightfactorclosedloopvel(1.0);
+    auto paramsUnequalLimits = params; // other limit ratios between X and Y, so for some directions not fused
+    paramsUnequalLimits.mutable_limits(0)->mutable_maxvel()->set_x(0.5);
+    paramsUnequalLimits.mutable_limits(0)->mutable_maxacc()->set_x(0.8);
+    auto input = FalconsVelocityControl::Input();
+    input.mutable_worldstate()->mutable_robot()->set_active(true);
+    auto state = FalconsVelocityControl::State();
+    auto output = FalconsVelocityControl::Output();
+    auto local = FalconsVelocityControl::Local();
+    MRA::internal::FVC::VelocityControl vc;
+    vc.data.timestamp = google::protobuf::util::TimeUtil::GetCurrentTime();
+    vc.data.input = &input;
+    vc.data.state = &state;
+    vc.data.output = &output;
+    vc.data.diag = &local;
+    std::mt19937 generator(46);
+    std::uniform_real_distribution<double> uniform(-1.0, 1.0);
+    int numScenarios = 200;
+    int numFused = 0; // calculations
+    int numNotPhaseSynchronized = 0; // scenarios
+    int numCalculations = 0;
+
+    // Act & Assert
+    for (int it = 0; it < numScenarios; ++it)
+    {
+        // along a random direction in FCS: delta position, current velocity (possibly away from the target)
+        double angle = M_PI * uniform(generator);
+        double distance = 2.0 + 1.5 * uniform(generator);
+        double speed = 1.0 * uniform(generator);
+        auto robot = input.mutable_worldstate()->mutable_robot();
+        robot->mutable_position()->set_x(uniform(generator));
+        robot->mutable_position()->set_y(uniform(generator));
+        robot->mutable_position()->set_rz(M_PI * uniform(generator));
+        robot->mutable_velocity()->set_x(speed * cos(angle));
+        robot->mutable_velocity()->set_y(speed * sin(angle));
+        robot->mutable_velocity()->set_rz(uniform(generator));
+        input.mutable_setpoint()->mutable_position()->set_x(robot->position().x() + distance * cos(angle));
+        input.mutable_setpoint()->mutable_position()->set_y(robot->position().y() + distance * sin(angle));
+        input.mutable_setpoint()->mutable_position()->set_rz(robot->position().rz() + uniform(generator));
+        vc.configure((it % 2) ? paramsUnequalLimits : params);
+        auto tick = [&](bool fuse)
+        {
+            // (the controller is created on the first tick after configure)
+            auto spg = std::dynamic_pointer_cast<SPGVelocitySetpointController>(vc.data.controller);
+            // with weightFactorClosedLoopPos 1, the RCS rotation follows the previous rz setpoint (see SPGVelocitySetpointController::calculate),
+            // so keep that at the robot
+            state.Clear();
+            state.mutable_positionsetpointfcs()->set_rz(robot->position().rz());
+            local.Clear();
+            if (spg)
+            {
+                spg->fuseCollinearXY = fuse;
+            }
+            vc.iterate();
+            spg = std::dynamic_pointer_cast<SPGVelocitySetpointController>(vc.data.controller);
+            ASSERT_TRUE(spg);
+            spg->fuseCollinearXY = true;
+        };
+        tick(true);
+        ASSERT_EQ(local.spg().calculations() > 0, true);
+        auto fusedOutput = output;
+        auto fusedSpg = local.spg();
+        tick(false);
+
+        // the line in RCS, to check whether the XY velocity is on it (up to the float precision of the FCS to RCS rotation)
+        double angleRcs = angle - robot->position().rz();
+        auto isOnLine = [angleRcs](FalconsVelocityControl::Output const &o)
+        {
+            return fabs(o.velocity().x() * sin(angleRcs) - o.velocity().y() * cos(angleRcs)) < 1e-6;
+        };
+        EXPECT_EQ(local.spg().solves(), 2 * local.spg().calculations()) << "scenario " << it;
+        EXPECT_GE(fusedSpg.solves(), fusedSpg.calculations()) << "scenario " << it;
+        EXPECT_LE(fusedSpg.solves(), 2 * fusedSpg.calculations()) << "scenario " << it;
+        int numFusedCalculations = 2 * fusedSpg.calculations() - fusedSpg.solves();
+        if (numFusedCalculations == 0)
+        {
+            EXPECT_EQ(it % 2, 1) << "scenario " << it; // equal X and Y limits: always fused
+            EXPECT_EQ(fusedOutput.SerializeAsString(), output.SerializeAsString()) << "scenario " << it;
+        }
+        else if (isOnLine(output))
+        {
+            EXPECT_TRUE(TestFactory::areProtosEqualWithTolerance(fusedOutput, output, 1e-9)) << "scenario " << it;
+        }
+        else
+        {
+            // Reflexxes rejected phase synchronization for numerical reasons and time synchronized XY,
+            // so the robot would have left the line: the fused result does not
+            numNotPhaseSynchronized++;
+        }
+        if (numFusedCalculations == fusedSpg.calculations())
+        {
+            EXPECT_TRUE(isOnLine(fusedOutput)) << "scenario " << it;
+        }
+        numFused += numFusedCalculations;
+        numCalculations += fusedSpg.calculations();
+    }
+    EXPECT_GT(numFused, numCalculations / 2);
+    EXPECT_LT(numFused, numCalculations);
+    EXPECT_LT(numNotPhaseSynchronized, numScenarios / 5);
+    EXPECT_GT(numCalculations, numScenarios);
+
+    // not collinear: separate solves
+    input.mutable_worldstate()->mutable_robot()->mutable_velocity()->set_x(0.3);
+    input.mutable_worldstate()->mutable_robot()->mutable_velocity()->set_y(-0.7);
+    input.mutable_setpoint()->mutable_position()->set_x(2.0);
+    input.mutable_setpoint()->mutable_position()->set_y(2.0);
+    local.Clear();
+    vc.iterate();
+    EXPECT_EQ(local.spg().solves(), 2 * local.spg().calculations());
+}
+
 TEST(FalconsVelocityControlTest, stop)
 {
     // Arrange
@@ -215,6 +371,647 @@ TEST(FalconsVelocityControlTest, noHotRestart)
     EXPECT_LT(output.velocity().rz(), 0.1);
 }
 
+// The pipeline is kept between ticks and only reconfigured on params change.
+// Repeating a tick shall give the same result, also after ticking with other params in between.
+TEST(FalconsVelocityControlTest, persistentPipeline)
+{
+    // Arrange
+    auto m = FalconsVelocityControl::FalconsVelocityControl();
+    auto input = FalconsVelocityControl::Input();
+    auto params = m.defaultParams();
+    auto otherParams = params;
+    otherParams.mutable_spg()->set_synchronizerotation(true);
+    otherParams.set_dt(0.1);
+    input.mutable_worldstate()->mutable_robot()->set_active(true);
+    input.mutable_worldstate()->mutable_robot()->mutable_position()->set_x(1.0);
+    input.mutable_worldstate()->mutable_robot()->mutable_velocity()->set_y(0.5);
+    input.mutable_setpoint()->mutable_position()->set_x(2.0);
+    input.mutable_setpoint()->mutable_position()->set_rz(1.0);
+    std::vector<FalconsVelocityControl::Output> outputs(4);
+    std::vector<FalconsVelocityControl::State> states(4);
+
+    // Act
+    std::vector<int> error_values;
+    for (int it = 0; it < 4; ++it)
+    {
+        auto local = FalconsVelocityControl::Local();
+        error_values.push_back(m.tick(input, (it == 2) ? otherParams : params, states[it], outputs[it], local));
+    }
+
+    // Assert
+    EXPECT_THAT(error_values, Each(0));
+    EXPECT_GT(outputs[0].velocity().x(), 0.0);
+    EXPECT_EQ(outputs[1].SerializeAsString(), outputs[0].SerializeAsString());
+    EXPECT_EQ(states[1].SerializeAsString(), states[0].SerializeAsString());
+    EXPECT_NE(outputs[2].SerializeAsString(), outputs[0].SerializeAsString());
+    EXPECT_EQ(outputs[3].SerializeAsString(), outputs[0].SerializeAsString());
+    EXPECT_EQ(states[3].SerializeAsString(), states[0].SerializeAsString());
+}
+
+// Component instances with different params may tick interleaved on the same thread,
+// also more configurations than there are pipelines per thread.
+TEST(FalconsVelocityControlTest, interleavedParams)
+{
+    // Arrange
+    auto m = FalconsVelocityControl::FalconsVelocityControl();
+    auto input = FalconsVelocityControl::Input();
+    input.mutable_worldstate()->mutable_robot()->set_active(true);
+    input.mutable_worldstate()->mutable_robot()->mutable_position()->set_x(1.0);
+    input.mutable_worldstate()->mutable_robot()->mutable_velocity()->set_y(0.5);
+    input.mutable_setpoint()->mutable_position()->set_x(2.0);
+    input.mutable_setpoint()->mutable_position()->set_rz(1.0);
+    int numConfigurations = 6;
+    std::vector<FalconsVelocityControl::Params> params(numConfigurations, m.defaultParams());
+    for (int it = 0; it < numConfigurations; ++it)
+    {
+        params[it].mutable_limits(0)->mutable_maxacc()->set_x(0.5 + 0.1 * it);
+    }
+    std::vector<FalconsVelocityControl::Output> outputs(numConfigurations);
+
+    // Act & Assert
+    for (int round = 0; round < 3; ++round)
+    {
+        for (int it = 0; it < numConfigurations; ++it)
+        {
+            auto state = FalconsVelocityControl::State();
+            auto output = FalconsVelocityControl::Output();
+            auto local = FalconsVelocityControl::Local();
+            EXPECT_EQ(m.tick(input, params[it], state, output, local), 0);
+            if (round == 0)
+            {
+                outputs[it] = output;
+            }
+            else
+            {
+                EXPECT_EQ(output.SerializeAsString(), outputs[it].SerializeAsString()) << "round " << round << " configuration " << it;
+            }
+        }
+    }
+    EXPECT_NE(outputs[1].SerializeAsString(), outputs[0].SerializeAsString());
+}
+
+// A velocity-only setpoint is handled by a lighter chain of algorithms, without Deadzone.
+TEST(FalconsVelocityControlTest, velOnlyAlgorithmChain)
+{
+    // Arrange
+    auto m = FalconsVelocityControl::FalconsVelocityControl();
+    auto params = m.defaultParams();
+    auto input = FalconsVelocityControl::Input();
+    input.mutable_worldstate()->mutable_robot()->set_active(true);
+    input.mutable_worldstate()->mutable_robot()->mutable_position();
+    input.mutable_worldstate()->mutable_robot()->mutable_velocity();
+    auto velInput = input;
+    velInput.mutable_setpoint()->mutable_velocity()->set_x(1.0);
+    auto posInput = input;
+    posInput.mutable_setpoint()->mutable_position()->set_x(1.0);
+    auto state = FalconsVelocityControl::State();
+    auto output = FalconsVelocityControl::Output();
+    auto velLocal = FalconsVelocityControl::Local();
+    auto posLocal = FalconsVelocityControl::Local();
+
+    // Act
+    int error_value1 = m.tick(velInput, params, state, output, velLocal);
+    int error_value2 = m.tick(posInput, params, state, output, posLocal);
+
+    // Assert
+    EXPECT_EQ(error_value1, 0);
+    EXPECT_EQ(error_value2, 0);
+    EXPECT_EQ(velLocal.controlmode(), FalconsVelocityControl::ControlModeEnum::VEL_ONLY);
+    EXPECT_EQ(posLocal.controlmode(), FalconsVelocityControl::ControlModeEnum::POS_ONLY);
+    EXPECT_EQ(velLocal.numalgorithmsexecuted(), posLocal.numalgorithmsexecuted() - 1);
+}
+
+// Limits are selected by motion profile, or automatically by the robot having the ball.
+TEST(FalconsVelocityControlTest, motionProfileLimits)
+{
+    // Arrange
+    auto m = FalconsVelocityControl::FalconsVelocityControl();
+    auto params = m.defaultParams();
+    ASSERT_EQ(params.limits(1).name(), "withBall");
+    auto input = FalconsVelocityControl::Input();
+    input.mutable_worldstate()->mutable_robot()->set_active(true);
+    input.mutable_worldstate()->mutable_robot()->mutable_position();
+    input.mutable_worldstate()->mutable_robot()->mutable_velocity();
+    input.mutable_setpoint()->mutable_velocity()->set_y(-3.0);
+    auto inputWithBall = input;
+    inputWithBall.mutable_worldstate()->mutable_robot()->set_hasball(true);
+    auto inputProfile1 = input;
+    inputProfile1.set_motionprofile(1);
+    auto inputInvalidProfile = input;
+    inputInvalidProfile.set_motionprofile(2);
+    std::vector<FalconsVelocityControl::Output> outputs(4);
+
+    // Act
+    std::vector<int> error_values;
+    int it = 0;
+    for (auto const &in: {input, inputWithBall, inputProfile1, inputInvalidProfile})
+    {
+        auto state = FalconsVelocityControl::State();
+        auto local = FalconsVelocityControl::Local();
+        error_values.push_back(m.tick(in, params, state, outputs[it++], local));
+    }
+
+    // Assert
+    EXPECT_THAT(error_values, ElementsAre(0, 0, 0, -1));
+    EXPECT_NE(outputs[1].velocity().y(), outputs[0].velocity().y());
+    EXPECT_EQ(outputs[1].velocity().y(), outputs[2].velocity().y());
+}
+
+// Predicting the limits shall not change the result when the prediction is right (accelerating from standstill),
+// while saving the recalculation.
+TEST(FalconsVelocityControlTest, predictLimits)
+{
+    // Arrange
+    auto m = FalconsVelocityControl::FalconsVelocityControl();
+    auto input = FalconsVelocityControl::Input();
+    input.mutable_worldstate()->mutable_robot()->set_active(true);
+    input.mutable_worldstate()->mutable_robot()->mutable_position()->set_x(1.0);
+    input.mutable_worldstate()->mutable_robot()->mutable_velocity();
+    input.mutable_setpoint()->mutable_position()->set_x(3.0);
+    input.mutable_setpoint()->mutable_position()->set_y(-2.0);
+    input.mutable_setpoint()->mutable_position()->set_rz(1.0);
+    auto params = m.defaultParams();
+    ASSERT_TRUE(params.spg().predictlimits());
+    params.set_profiling(true);
+    auto paramsLegacy = params;
+    paramsLegacy.mutable_spg()->set_predictlimits(false);
+    auto state = FalconsVelocityControl::State();
+    auto output = FalconsVelocityControl::Output();
+    auto outputLegacy = FalconsVelocityControl::Output();
+    auto local = FalconsVelocityControl::Local();
+    auto localLegacy = FalconsVelocityControl::Local();
+
+    // Act
+    int error_value = m.tick(input, params, state, output, local);
+    state.Clear();
+    int error_value2 = m.tick(input, paramsLegacy, state, outputLegacy, localLegacy);
+
+    // Assert
+    EXPECT_EQ(error_value, 0);
+    EXPECT_EQ(error_value2, 0);
+    EXPECT_GT(output.velocity().x(), 0.0);
+    EXPECT_LT(output.velocity().y(), 0.0);
+    EXPECT_TRUE(TestFactory::areProtosEqualWithTolerance(output, outputLegacy, 1e-9));
+    EXPECT_EQ(local.spg().calculations(), 1);
+    EXPECT_EQ(localLegacy.spg().calculations(), 2);
+}
+
+// When the prediction is wrong, a single recalculation shall follow, with the limits selected by the first calculation.
+// Here the prediction treats Rz on its own, while it is synchronized with the (much longer) XY move, so it has to brake.
+TEST(FalconsVelocityControlTest, predictLimitsWrong)
+{
+    // Arrange
+    auto m = FalconsVelocityControl::FalconsVelocityControl();
+    auto input = FalconsVelocityControl::Input();
+    input.mutable_worldstate()->mutable_robot()->set_active(true);
+    input.mutable_worldstate()->mutable_robot()->mutable_position();
+    input.mutable_worldstate()->mutable_robot()->mutable_velocity()->set_rz(1.0);
+    input.mutable_setpoint()->mutable_position()->set_x(3.0);
+    input.mutable_setpoint()->mutable_position()->set_rz(1.5);
+    auto params = m.defaultParams();
+    params.set_profiling(true);
+    params.mutable_spg()->set_synchronizerotation(true);
+    auto paramsLegacy = params;
+    paramsLegacy.mutable_spg()->set_predictlimits(false);
+    auto state = FalconsVelocityControl::State();
+    state.mutable_velocitysetpointfcs()->set_rz(1.0);
+    auto stateLegacy = state;
+    auto output = FalconsVelocityControl::Output();
+    auto outputLegacy = FalconsVelocityControl::Output();
+    auto local = FalconsVelocityControl::Local();
+    auto localLegacy = FalconsVelocityControl::Local();
+
+    // Act
+    int error_value = m.tick(input, params, state, output, local);
+    int error_value2 = m.tick(input, paramsLegacy, stateLegacy, outputLegacy, localLegacy);
+
+    // Assert
+    EXPECT_EQ(error_value, 0);
+    EXPECT_EQ(error_value2, 0);
+    EXPECT_GT(output.velocity().x(), 0.0);
+    EXPECT_LT(output.velocity().rz(), 1.0);
+    EXPECT_EQ(local.spg().calculations(), 2);
+    EXPECT_EQ(local.spg().recalculations(), 1);
+    EXPECT_TRUE(TestFactory::areProtosEqualWithTolerance(output, outputLegacy, 1e-9));
+}
+
+// On random scenarios, predicting the limits shall save at least 20% of the calculations.
+// The result is the same as starting from the deceleration limits, except where both schemes settle on other limits
+// (for instance when a DOF can accelerate and still brake in time with the deceleration limits, but not with the acceleration limits),
+// which changes the velocity by at most one tick of (acceleration plus deceleration).
+TEST(FalconsVelocityControlTest, predictLimitsRandomized)
+{
+    // Arrange
+    auto m = FalconsVelocityControl::FalconsVelocityControl();
+    auto params = m.defaultParams();
+    ASSERT_TRUE(params.spg().predictlimits());
+    params.set_profiling(true);
+    auto paramsLegacy = params;
+    paramsLegacy.mutable_spg()->set_predictlimits(false);
+    auto const &limits = params.limits(0);
+    double maxDifferenceXY = (std::max(limits.maxacc().x(), limits.maxacc().yforward()) + limits.maxdec().x()) * params.dt() + 1e-9;
+    double maxDifferenceRz = (limits.maxacc().rz() + limits.maxdec().rz()) * params.dt() + 1e-9;
+    auto input = FalconsVelocityControl::Input();
+    input.mutable_worldstate()->mutable_robot()->set_active(true);
+    std::mt19937 generator(45);
+    std::uniform_real_distribution<double> uniform(-1.0, 1.0);
+    int numScenarios = 1000;
+    int numDifferent = 0;
+    int numCalculations = 0;
+    int numCalculationsLegacy = 0;
+
+    // Act & Assert
+    for (int it = 0; it < numScenarios; ++it)
+    {
+        // position, position and velocity, or velocity setpoints; with or without synchronized rotation
+        auto robot = input.mutable_worldstate()->mutable_robot();
+        robot->mutable_position()->set_x(6.0 * uniform(generator));
+        robot->mutable_position()->set_y(9.0 * uniform(generator));
+        robot->mutable_position()->set_rz(M_PI * uniform(generator));
+        robot->mutable_velocity()->set_x(1.5 * uniform(generator));
+        robot->mutable_velocity()->set_y(1.5 * uniform(generator));
+        robot->mutable_velocity()->set_rz(2.0 * uniform(generator));
+        input.mutable_setpoint()->Clear();
+        if (it % 4 != 3)
+        {
+            input.mutable_setpoint()->mutable_position()->set_x(robot->position().x() + 3.0 * uniform(generator));
+            input.mutable_setpoint()->mutable_position()->set_y(robot->position().y() + 3.0 * uniform(generator));
+            input.mutable_setpoint()->mutable_position()->set_rz(robot->position().rz() + 2.0 * uniform(generator));
+        }
+        if (it % 4 >= 2)
+        {
+            input.mutable_setpoint()->mutable_velocity()->set_x(uniform(generator));
+            input.mutable_setpoint()->mutable_velocity()->set_y(uniform(generator));
+            input.mutable_setpoint()->mutable_velocity()->set_rz(uniform(generator));
+        }
+        params.mutable_spg()->set_synchronizerotation(it % 3 == 0);
+        paramsLegacy.mutable_spg()->set_synchronizerotation(it % 3 == 0);
+        // continuing from the previous setpoint, which (with the default weight factors) provides the current velocity
+        auto state = FalconsVelocityControl::State();
+        state.mutable_positionsetpointfcs()->CopyFrom(robot->position());
+        state.mutable_velocitysetpointfcs()->CopyFrom(robot->velocity());
+        auto stateLegacy = state;
+        auto output = FalconsVelocityControl::Output();
+        auto outputLegacy = FalconsVelocityControl::Output();
+        auto local = FalconsVelocityControl::Local();
+        auto localLegacy = FalconsVelocityControl::Local();
+        EXPECT_EQ(m.tick(input, params, state, output, local), 0);
+        EXPECT_EQ(m.tick(input, paramsLegacy, stateLegacy, outputLegacy, localLegacy), 0);
+        EXPECT_LE(local.spg().calculations(), 2) << "scenario " << it;
+        if (!TestFactory::areProtosEqualWithTolerance(output, outputLegacy, 1e-9))
+        {
+            numDifferent++;
+            EXPECT_NEAR(output.velocity().x(), outputLegacy.velocity().x(), maxDifferenceXY) << "scenario " << it;
+            EXPECT_NEAR(output.velocity().y(), outputLegacy.velocity().y(), maxDifferenceXY) << "scenario " << it;
+            EXPECT_NEAR(output.velocity().rz(), outputLegacy.velocity().rz(), maxDifferenceRz) << "scenario " << it;
+        }
+        numCalculations += local.spg().calculations();
+        numCalculationsLegacy += localLegacy.spg().calculations();
+    }
+    EXPECT_LT(numCalculations, 0.8 * numCalculationsLegacy);
+    EXPECT_LT(numDifferent, numScenarios / 10);
+}
+
+// The testdata vectors were recorded without predicting the limits, predicting them shall give the same outputs.
+static void runTestvectorPredictLimits(std::string const &filename, double tolerance)
+{
+    auto m = FalconsVelocityControl::FalconsVelocityControl();
+    auto input = FalconsVelocityControl::Input();
+    auto params = FalconsVelocityControl::Params();
+    auto state = FalconsVelocityControl::State();
+    auto local = FalconsVelocityControl::Local();
+    auto expectedOutput = FalconsVelocityControl::Output();
+    auto output = FalconsVelocityControl::Output();
+    nlohmann::json j = nlohmann::json::parse(read_file_as_string(filename));
+    convert_json_to_proto(j, "Input", input);
+    convert_json_to_proto(j, "Params", params);
+    convert_json_to_proto(j, "State", state);
+    convert_json_to_proto(j, "Output", expectedOutput);
+    ASSERT_FALSE(params.spg().predictlimits());
+    params.mutable_spg()->set_predictlimits(true);
+    EXPECT_EQ(m.tick(input, params, state, output, local), 0);
+    EXPECT_TRUE(TestFactory::areProtosEqualWithTolerance(output, expectedOutput, tolerance));
+}
+
+TEST(FalconsVelocityControlTest, predictLimitsTestdata)
+{
+    double tolerance = 1e-5;
+    runTestvectorPredictLimits("components/falcons/velocity_control/testdata/bug_nonconverging_rz.json", tolerance);
+    runTestvectorPredictLimits("components/falcons/velocity_control/testdata/bug_large_xy_jump.json", tolerance);
+}
+
+// With motor limits, the velocity shall saturate where the wheel velocities are feasible.
+TEST(FalconsVelocityControlTest, motorLimits)
+{
+    // Arrange
+    auto m = FalconsVelocityControl::FalconsVelocityControl();
+    auto params = m.defaultParams();
+    auto motorLimits = params.mutable_motorlimits();
+    motorLimits->set_enabled(true);
+    motorLimits->set_maxwheelvelocity(1.0);
+    auto input = FalconsVelocityControl::Input();
+    input.mutable_worldstate()->mutable_robot()->set_active(true);
+    input.mutable_worldstate()->mutable_robot()->mutable_position();
+    input.mutable_worldstate()->mutable_robot()->mutable_velocity();
+    input.mutable_setpoint()->mutable_velocity()->set_y(1.6);
+    auto state = FalconsVelocityControl::State();
+    auto output = FalconsVelocityControl::Output();
+    auto local = FalconsVelocityControl::Local();
+
+    // Act
+    // robot follows the setpoint perfectly, until converged
+    std::vector<int> error_values;
+    for (int it = 0; it < 80; ++it)
+    {
+        error_values.push_back(m.tick(input, params, state, output, local));
+        *input.mutable_worldstate()->mutable_robot()->mutable_velocity() = output.velocity();
+    }
+
+    // Assert
+    EXPECT_THAT(error_values, Each(0));
+    // the limits box (1.6, 1.6, 2.0) is scaled by the most demanding wheel (at 30 degrees)
+    double factor = 1.0 / (0.5 * 1.6 + cos(0.5236) * 1.6 + 0.2 * 2.0);
+    EXPECT_NEAR(output.velocity().y(), 1.6 * factor, 1e-4);
+    for (double angle: motorLimits->wheelangles())
+    {
+        double wheelVelocity = -sin(angle) * output.velocity().x() + cos(angle) * output.velocity().y() + 0.2 * output.velocity().rz();
+        EXPECT_LE(fabs(wheelVelocity), 1.0);
+    }
+}
+
+// Invalid motor limits configuration shall be rejected.
+TEST(FalconsVelocityControlTest, motorLimitsIncomplete)
+{
+    // Arrange
+    auto m = FalconsVelocityControl::FalconsVelocityControl();
+    auto params = m.defaultParams();
+    params.mutable_motorlimits()->set_enabled(true);
+    params.mutable_motorlimits()->clear_wheelangles();
+    auto input = FalconsVelocityControl::Input();
+    input.mutable_worldstate()->mutable_robot()->set_active(true);
+    input.mutable_worldstate()->mutable_robot()->mutable_position();
+    input.mutable_worldstate()->mutable_robot()->mutable_velocity();
+    input.mutable_setpoint()->mutable_velocity()->set_y(1.0);
+    auto output = FalconsVelocityControl::Output();
+
+    // Act
+    int error_value = m.tick(input, params, output);
+    int error_value2 = m.tick(input, params, output);
+
+    // Assert
+    EXPECT_EQ(error_value, -1);
+    EXPECT_EQ(error_value2, -1);
+}
+
+// The trajectory description shall continue the velocity output, to be sampled at a higher rate than dt.
+TEST(FalconsVelocityControlTest, trajectoryOutput)
+{
+    // Arrange
+    auto m = FalconsVelocityControl::FalconsVelocityControl();
+    auto input = FalconsVelocityControl::Input();
+    input.mutable_worldstate()->mutable_robot()->set_active(true);
+    input.mutable_worldstate()->mutable_robot()->mutable_position()->set_x(1.0);
+    input.mutable_worldstate()->mutable_robot()->mutable_velocity();
+    input.mutable_setpoint()->mutable_position()->set_x(2.0);
+    auto params = m.defaultParams();
+    float acc = 1.5;
+    params.mutable_limits(0)->mutable_maxacc()->set_x(acc);
+    float dt = 1.0 / 40;
+    params.set_dt(dt);
+    auto output = FalconsVelocityControl::Output();
+    auto outputTrajectory = FalconsVelocityControl::Output();
+    auto paramsTrajectory = params;
+    paramsTrajectory.mutable_trajectory()->set_enabled(true);
+    paramsTrajectory.mutable_trajectory()->set_horizon(0.1);
+
+    // Act
+    int error_value = m.tick(input, params, output);
+    int error_value2 = m.tick(input, paramsTrajectory, outputTrajectory);
+
+    // Assert
+    EXPECT_EQ(error_value, 0);
+    EXPECT_EQ(error_value2, 0);
+    EXPECT_FALSE(output.has_trajectory());
+    ASSERT_TRUE(outputTrajectory.has_trajectory());
+    auto const &trajectory = outputTrajectory.trajectory();
+    EXPECT_NEAR(trajectory.validity(), 0.1, 1e-9);
+    // still accelerating at the end of the horizon: a single segment
+    EXPECT_EQ(trajectory.segments_size(), 1);
+    auto v0 = MRA::internal::FVC::sampleTrajectory(trajectory, 0.0);
+    auto v1 = MRA::internal::FVC::sampleTrajectory(trajectory, 0.001);
+    auto v2 = MRA::internal::FVC::sampleTrajectory(trajectory, 0.05);
+    EXPECT_FLOAT_EQ(v0.x, output.velocity().x());
+    EXPECT_FLOAT_EQ(v1.x, acc * (dt + 0.001));
+    EXPECT_FLOAT_EQ(v2.x, acc * (dt + 0.05));
+    EXPECT_FLOAT_EQ(v2.y, 0.0);
+    EXPECT_FLOAT_EQ(v2.rz, 0.0);
+}
+
+// The trajectory shall follow the Reflexxes trajectory over the horizon, also across acceleration switches,
+// and sampling shall rotate x,y along with the robot.
+TEST(FalconsVelocityControlTest, trajectoryAccelerationSwitch)
+{
+    // Arrange
+    auto m = FalconsVelocityControl::FalconsVelocityControl();
+    auto input = FalconsVelocityControl::Input();
+    input.mutable_worldstate()->mutable_robot()->set_active(true);
+    input.mutable_worldstate()->mutable_robot()->mutable_position();
+    input.mutable_worldstate()->mutable_robot()->mutable_velocity();
+    input.mutable_setpoint()->mutable_position()->set_x(0.1);
+    input.mutable_setpoint()->mutable_position()->set_rz(0.1);
+    auto params = m.defaultParams();
+    double horizon = 0.5;
+    params.mutable_trajectory()->set_enabled(true);
+    params.mutable_trajectory()->set_horizon(horizon);
+    auto state = FalconsVelocityControl::State();
+    auto output = FalconsVelocityControl::Output();
+    auto local = FalconsVelocityControl::Local();
+    MRA::internal::FVC::VelocityControl vc;
+    vc.data.timestamp = google::protobuf::util::TimeUtil::GetCurrentTime();
+    vc.data.input = &input;
+    vc.data.state = &state;
+    vc.data.output = &output;
+    vc.data.diag = &local;
+
+    // Act
+    vc.configure(params);
+    vc.iterate();
+
+    // Assert: compare against Reflexxes, rotated by its integrated rz velocity
+    auto spg = std::dynamic_pointer_cast<SPGVelocitySetpointController>(vc.data.controller);
+    ASSERT_TRUE(spg);
+    auto const &trajectory = output.trajectory();
+    EXPECT_NEAR(trajectory.validity(), horizon, 1e-9);
+    EXPECT_GT(trajectory.segments_size(), 1);
+    double t0 = params.dt() + params.spg().latencyoffset();
+    double step = 1e-4;
+    double rotation = 0.0;
+    Velocity2D v, a, vPrevious;
+    spg->sampleLastSolve(t0, vPrevious, a);
+    for (int it = 0; it * step <= horizon; ++it)
+    {
+        double t = it * step;
+        spg->sampleLastSolve(t0 + t, v, a);
+        rotation += (it > 0) * 0.5 * (v.rz + vPrevious.rz) * step; // exact, as long as no switch falls within the step
+        vPrevious = v;
+        if (it % 50 == 0)
+        {
+            auto sample = MRA::internal::FVC::sampleTrajectory(trajectory, t);
+            EXPECT_NEAR(sample.x, cos(rotation) * v.x + sin(rotation) * v.y, 1e-4) << "t=" << t;
+            EXPECT_NEAR(sample.y, -sin(rotation) * v.x + cos(rotation) * v.y, 1e-4) << "t=" << t;
+            EXPECT_NEAR(sample.rz, v.rz, 1e-4) << "t=" << t;
+        }
+    }
+    EXPECT_GT(rotation, 0.05);
+}
+
+// The trajectory shall merge segments of equal acceleration, and not exceed its capacity.
+TEST(FalconsVelocityControlTest, trajectoryCapacity)
+{
+    // Arrange
+    MRA::internal::FVC::VelocityTrajectory trajectory;
+    int capacity = MRA::internal::FVC::VelocityTrajectory::MAX_SEGMENTS;
+    std::vector<bool> added;
+
+    // Act
+    trajectory.add(0.1, Velocity2D(), Velocity2D(1.0, 0.0, 0.0, 0.0, 0.0, 0.0));
+    trajectory.add(0.1, Velocity2D(0.1, 0.0, 0.0, 0.0, 0.0, 0.0), Velocity2D(1.0, 0.0, 0.0, 0.0, 0.0, 0.0));
+    int numSegmentsMerged = trajectory.numSegments;
+    for (int it = 1; it <= capacity; ++it)
+    {
+        added.push_back(trajectory.add(0.1, Velocity2D(), Velocity2D((it % 2) ? -1.0 : 1.0, 0.0, 0.0, 0.0, 0.0, 0.0)));
+    }
+
+    // Assert
+    EXPECT_EQ(numSegmentsMerged, 1);
+    EXPECT_NEAR(trajectory.segments[0].duration, 0.2, 1e-12);
+    EXPECT_EQ(trajectory.numSegments, capacity);
+    EXPECT_TRUE(trajectory.full());
+    EXPECT_EQ(std::count(added.begin(), added.end(), true), capacity - 1);
+    EXPECT_FALSE(added.back());
+    EXPECT_NEAR(trajectory.duration(), 0.1 * (capacity + 1), 1e-12);
+}
+
+// Profiling shall report each executed algorithm and the SPG calculations.
+TEST(FalconsVelocityControlTest, profiling)
+{
+    // Arrange
+    auto m = FalconsVelocityControl::FalconsVelocityControl();
+    auto input = FalconsVelocityControl::Input();
+    input.mutable_worldstate()->mutable_robot()->set_active(true);
+    input.mutable_worldstate()->mutable_robot()->mutable_position()->set_x(1.0);
+    input.mutable_worldstate()->mutable_robot()->mutable_velocity();
+    input.mutable_setpoint()->mutable_position()->set_x(2.0);
+    auto params = m.defaultParams();
+    ASSERT_FALSE(params.profiling());
+    auto paramsProfiling = params;
+    paramsProfiling.set_profiling(true);
+    auto state = FalconsVelocityControl::State();
+    auto output = FalconsVelocityControl::Output();
+    auto local = FalconsVelocityControl::Local();
+    auto localProfiling = FalconsVelocityControl::Local();
+
+    // Act
+    int error_value = m.tick(input, params, state, output, local);
+    state.Clear();
+    int error_value2 = m.tick(input, paramsProfiling, state, output, localProfiling);
+
+    // Assert
+    EXPECT_EQ(error_value, 0);
+    EXPECT_EQ(error_value2, 0);
+    EXPECT_EQ(local.timing_size(), 0);
+    EXPECT_FALSE(local.has_spg());
+    // (numAlgorithmsExecuted is written by SetOutputsPrepareNext, so excludes itself)
+    ASSERT_EQ(localProfiling.timing_size(), localProfiling.numalgorithmsexecuted() + 1);
+    EXPECT_EQ(localProfiling.timing(0).algorithm(), "CheckPrepareInputs");
+    EXPECT_EQ(localProfiling.timing(localProfiling.timing_size() - 1).algorithm(), "SetOutputsPrepareNext");
+    for (auto const &timing: localProfiling.timing())
+    {
+        EXPECT_GE(timing.duration(), 0.0);
+    }
+    // accelerating: the limits are predicted, so no recalculation (and X is fused with Rz into one solve)
+    EXPECT_EQ(localProfiling.spg().calculations(), 1);
+    EXPECT_EQ(localProfiling.spg().recalculations(), 0);
+    EXPECT_EQ(localProfiling.spg().solves(), 1);
+    EXPECT_EQ(localProfiling.spg().errors(), 0);
+}
+
+// A batch of robots shall give the same results as ticking each robot individually, also when multithreaded.
+TEST(FalconsVelocityControlTest, batch)
+{
+    // Arrange
+    auto m = FalconsVelocityControl::FalconsVelocityControl();
+    auto params = m.defaultParams();
+    auto timestamp = google::protobuf::util::TimeUtil::GetCurrentTime();
+    int numItems = 7;
+    std::vector<FalconsVelocityControl::Input> inputs(numItems);
+    for (int it = 0; it < numItems; ++it)
+    {
+        inputs[it].mutable_worldstate()->mutable_robot()->set_active(true);
+        inputs[it].mutable_worldstate()->mutable_robot()->mutable_position()->set_x(0.1 * it);
+        inputs[it].mutable_worldstate()->mutable_robot()->mutable_velocity()->set_y(0.2 * it);
+        inputs[it].mutable_setpoint()->mutable_position()->set_x(1.0);
+        inputs[it].mutable_setpoint()->mutable_position()->set_rz(0.3 * it);
+    }
+    inputs[3].mutable_setpoint()->mutable_position()->set_z(1.0); // invalid item
+    std::vector<FalconsVelocityControl::State> expectedStates(numItems);
+    std::vector<FalconsVelocityControl::Output> expectedOutputs(numItems);
+    std::vector<int> expectedErrorValues(numItems);
+    for (int it = 0; it < numItems; ++it)
+    {
+        auto local = FalconsVelocityControl::Local();
+        expectedErrorValues[it] = m.tick(timestamp, inputs[it], params, expectedStates[it], expectedOutputs[it], local);
+    }
+    MRA::internal::FVC::VelocityControlBatch batch;
+    MRA::internal::FVC::VelocityControlBatch batchThreaded(2);
+    std::vector<FalconsVelocityControl::State> states, statesThreaded;
+    std::vector<FalconsVelocityControl::Output> outputs, outputsThreaded;
+    std::vector<FalconsVelocityControl::Local> locals, localsThreaded;
+    std::vector<int> errorValues, errorValuesThreaded;
+
+    // Act
+    int numFailed = batch.run(timestamp, params, inputs, states, outputs, locals, errorValues);
+    int numFailedThreaded = batchThreaded.run(timestamp, params, inputs, statesThreaded, outputsThreaded, localsThreaded, errorValuesThreaded);
+    auto statesAfterFirst = states;
+    auto outputsAfterFirst = outputs;
+    auto statesThreadedAfterFirst = statesThreaded;
+    auto outputsThreadedAfterFirst = outputsThreaded;
+    // next tick, on the same (persistent) worker threads
+    timestamp += google::protobuf::util::TimeUtil::MillisecondsToDuration(1000 * params.dt());
+    batch.run(timestamp, params, inputs, states, outputs, locals, errorValues);
+    batchThreaded.run(timestamp, params, inputs, statesThreaded, outputsThreaded, localsThreaded, errorValuesThreaded);
+    // a batch smaller than the number of threads
+    std::vector<FalconsVelocityControl::Input> inputsSingle(inputs.begin(), inputs.begin() + 1);
+    std::vector<FalconsVelocityControl::State> statesSingle;
+    std::vector<FalconsVelocityControl::Output> outputsSingle;
+    std::vector<FalconsVelocityControl::Local> localsSingle;
+    std::vector<int> errorValuesSingle;
+    int numFailedSingle = batchThreaded.run(timestamp, params, inputsSingle, statesSingle, outputsSingle, localsSingle, errorValuesSingle);
+
+    // Assert
+    EXPECT_EQ(numFailed, 1);
+    EXPECT_EQ(numFailedThreaded, 1);
+    EXPECT_EQ(expectedErrorValues[3], -1);
+    EXPECT_EQ(errorValues, expectedErrorValues);
+    EXPECT_EQ(errorValuesThreaded, expectedErrorValues);
+    ASSERT_EQ(outputs.size(), numItems);
+    ASSERT_EQ(outputsThreaded.size(), numItems);
+    for (int it = 0; it < numItems; ++it)
+    {
+        EXPECT_EQ(outputsAfterFirst[it].SerializeAsString(), expectedOutputs[it].SerializeAsString());
+        EXPECT_EQ(outputsThreadedAfterFirst[it].SerializeAsString(), expectedOutputs[it].SerializeAsString());
+        EXPECT_EQ(statesAfterFirst[it].SerializeAsString(), expectedStates[it].SerializeAsString());
+        EXPECT_EQ(statesThreadedAfterFirst[it].SerializeAsString(), expectedStates[it].SerializeAsString());
+        EXPECT_EQ(outputsThreaded[it].SerializeAsString(), outputs[it].SerializeAsString());
+        EXPECT_EQ(statesThreaded[it].SerializeAsString(), states[it].SerializeAsString());
+    }
+    EXPECT_EQ(errorValuesThreaded, errorValues);
+    EXPECT_GT(outputsAfterFirst[1].velocity().x(), 0.0);
+    EXPECT_EQ(numFailedSingle, 0);
+    ASSERT_EQ(outputsSingle.size(), 1);
+    EXPECT_EQ(outputsSingle[0].SerializeAsString(), expectedOutputs[0].SerializeAsString());
+}
+
 // Bug seen on Falcons simulation, where it appears that VelocityControl stops steering when xy is in spec but rz not.
 // The json file uses custom simulation configuration.
 // The data is literally copied from the debug logs at one of the moments when the bug manifested.
@@ -8,6 +8,44 @@ using namespace MRA;
 
 // internals
 #include "internal/include/VelocityControl.hpp"
+#include <array>
+
+// a few pipelines per thread, one per params configuration, so component instances with different params
+// (for instance robots with other limits) do not reconfigure each other every tick
+// when all are taken, the least recently used pipeline is reconfigured
+class VelocityControlCache
+{
+public:
+    // configured is set when the selected pipeline is already configured with given params
+    MRA::internal::FVC::VelocityControl &select(MRA::FalconsVelocityControl::Params const &params, bool &configured)
+    {
+        params.SerializeToString(&_serializedParams);
+        configured = false;
+        int selected = 0;
+        for (int it = 0; it < NUM_PIPELINES; ++it)
+        {
+            if (_pipelines[it].isConfiguredWith(_serializedParams))
+            {
+                configured = true;
+                selected = it;
+                break;
+            }
+            if (_lastUsed[it] < _lastUsed[selected])
+            {
+                selected = it;
+            }
+        }
+        _lastUsed[selected] = ++_numSelected;
+        return _pipelines[selected];
+    }
+
+private:
+    static constexpr int NUM_PIPELINES = 4;
+    std::array<MRA::internal::FVC::VelocityControl, NUM_PIPELINES> _pipelines;
+    std::array<uint64_t, NUM_PIPELINES> _lastUsed{};
+    uint64_t _numSelected = 0;
+    std::string _serializedParams; // reused, to not allocate every tick
+};
 
 
 int FalconsVelocityControl::FalconsVelocityControl::tick
@@ -27,17 +65,24 @@ int FalconsVelocityControl::FalconsVelocityControl::tick
 
     // relay to internal implementation which is a stripped version of the package `velocityControl` from falcons/code
     // making use of ReflexxesTypeII trajectory generation library
-    MRA::internal::FVC::VelocityControl controller;
+    // the pipeline is long-lived and only rebuilt when params change, since this is a high-rate component
+    // pipelines are per thread, so component instances may tick concurrently
+    // (no information is carried from one tick to the next other than via State, so instances may share them)
+    thread_local VelocityControlCache cache;
+    bool configured = false;
+    MRA::internal::FVC::VelocityControl &controller = cache.select(params, configured);
     controller.data.timestamp = timestamp;
-    controller.data.input = input;
-    controller.data.config = params;
-    controller.data.state = state;
+    controller.data.input = &input;
+    controller.data.state = &state;
+    controller.data.output = &output;
+    controller.data.diag = &local;
     try
     {
+        if (!configured)
+        {
+            controller.configure(params);
+        }
         controller.iterate();
-        output = controller.data.output;
-        state = controller.data.state;
-        local = controller.data.diag;
     }
     catch (const std::exception& e)
     {
@@ -49,6 +94,10 @@ int FalconsVelocityControl::FalconsVelocityControl::tick
         MRA_LOG_ERROR("ERROR: Caught an unknown exception.");
         error_value = -1;
     }
+    controller.data.input = nullptr;
+    controller.data.state = nullptr;
+    controller.data.output = nullptr;
+    controller.data.diag = nullptr;
 
     return error_value;
 }
@@ -21,6 +21,27 @@ void MRA::OpenCVUtils::deserializeCvMat(MRA::Datatypes::CvMatProto const &src, c
     memcpy(tgt.data, data.data(), data.size());
 }
 
+cv::Mat MRA::OpenCVUtils::wrapCvMat(MRA::Datatypes::CvMatProto const &src)
+{
+    const std::string& data = src.data();
+    cv::Mat result(src.height(), src.width(), src.type(), const_cast<char *>(data.data()));
+    if (result.total() * result.elemSize() != data.size())
+    {
+        throw std::runtime_error("wrapCvMat: data size (" + std::to_string(data.size()) + ") does not match shape");
+    }
+    return result;
+}
+
+cv::Mat MRA::OpenCVUtils::allocateCvMat(int rows, int cols, int type, MRA::Datatypes::CvMatProto &tgt)
+{
+    tgt.set_width(cols);
+    tgt.set_height(rows);
+    tgt.set_type(type);
+    std::string *data = tgt.mutable_data();
+    data->resize(rows * cols * CV_ELEM_SIZE(type));
+    return cv::Mat(rows, cols, type, data->data());
+}
+
 cv::Mat MRA::OpenCVUtils::joinWhitePixels(const cv::Mat& mat1, const cv::Mat& mat2)
 {
     CV_Assert(mat1.channels() == 1 && mat2.channels() == 1);
@@ -10,6 +10,14 @@ namespace MRA::OpenCVUtils
 void serializeCvMat(cv::Mat const &src, MRA::Datatypes::CvMatProto &tgt);
 void deserializeCvMat(MRA::Datatypes::CvMatProto const &src, cv::Mat &tgt);
 
+// zero-copy alternatives, for large images which are passed around every tick
+// the returned cv::Mat is a header over the bytes owned by the protobuf message,
+// so it is only valid as long as that message lives and its data field is not modified
+// wrapCvMat: read-only view, do not write into the returned cv::Mat
+cv::Mat wrapCvMat(MRA::Datatypes::CvMatProto const &src);
+// allocateCvMat: (re)size the message data and return a writable view, so an image can be produced directly into the message
+cv::Mat allocateCvMat(int rows, int cols, int type, MRA::Datatypes::CvMatProto &tgt);
+
 cv::Mat joinWhitePixels(const cv::Mat& mat1, const cv::Mat& mat2);
 
 } // namespace MRA::OpenCVUtils